@@ -2,6 +2,9 @@
 #include "ais.h"
 #include "radio.h"
 #include "fifo.h"
+#include "capture.h"
+#include "rxevent.h"
+#include "bench.h"
 
 //////////////////////////////////////////////////////////////////////////////
 // AIS support
@@ -31,27 +34,30 @@ enum PH_SYNC_STATE {
 };
 #define PH_PREAMBLE_LENGTH  8   // minimum number of alternating bits we need for a valid preamble
 #define PH_SYNC_TIMEOUT 16      // number of bits we wait for a preamble to start before changing channel
+#define PH_SYNC_TIMEOUT_HOLD 64 // same, after the radio detected a preamble
+#define PH_SKIP_PREAMBLE 2      // radio preamble timeout hops unless decoder saw more alternating bits
+#define PH_SYNC_EARLY_HOP 4     // byte decoder: hop at end of byte if timeout falls into next byte and fewer alternating bits were seen
+
 
 volatile uint8_t ph_state = PH_STATE_RESET;
 volatile uint8_t ph_last_error = PH_ERROR_NONE;
 volatile uint8_t ph_radio_channel = 0;
+uint8_t ph_sync_timeout = PH_SYNC_TIMEOUT;
 
-void ais_interrupt() {
-  static uint16_t rx_bitstream;       // shift register with incoming data
-  static uint16_t rx_bit_count;       // bit counter for various purposes
-  static uint16_t rx_crc;             // word for AIS payload CRC calculation
-  static uint8_t rx_one_count;        // counter of 1's to identify stuff bits
-  static uint8_t rx_data_byte;        // byte to receive actual package data
-  static uint8_t rx_prev_bit_NRZI;    // previous bit for NRZI decoding
-  static uint8_t rx_sync_state;       // state of preamble and start flag detection
-  static uint8_t rx_sync_count;       // length of valid bits in current sync sequence
+static uint16_t rx_bitstream;         // shift register with incoming data
+static uint16_t rx_bit_count;         // bit counter for various purposes
+static uint16_t rx_crc;               // word for AIS payload CRC calculation
+static uint8_t rx_one_count;          // counter of 1's to identify stuff bits
+static uint8_t rx_data_byte;          // byte to receive actual package data
+static uint8_t rx_prev_bit_NRZI;      // previous bit for NRZI decoding
+static uint8_t rx_sync_state;         // state of preamble and start flag detection
+static uint8_t rx_sync_count;         // length of valid bits in current sync sequence
 
-  uint8_t rx_this_bit_NRZI;           // current bit for NRZI decoding
+// decode one raw NRZI bit, shared by the bit-clock interrupt and the FIFO byte decoder
+static inline void ph_process_bit(uint8_t rx_this_bit_NRZI) {
   uint8_t rx_bit;                     // current decoded bit
 
-
-  // read data bit and decode NRZI
-  rx_this_bit_NRZI = digitalRead(radio_data) ? 1 : 0;
+  // decode NRZI
   rx_bit = !(rx_prev_bit_NRZI ^ rx_this_bit_NRZI); 	// NRZI decoding: change = 0-bit, no change = 1-bit, i.e. 00,11=>1, 01,10=>0, i.e. NOT(A XOR B)
   rx_prev_bit_NRZI = rx_this_bit_NRZI;				// store encoded bit for next round of decoding
 
@@ -74,6 +80,7 @@ void ais_interrupt() {
       fifo_write_byte(ph_radio_channel);          // indicate channel for this packet
       ph_state = PH_STATE_WAIT_FOR_SYNC;          // next state: wait for training sequence
       rx_sync_state = PH_SYNC_RESET;
+      ph_sync_timeout = PH_SYNC_TIMEOUT;
       break;
 
     // STATE: WAIT FOR PREAMBLE AND START FLAG
@@ -83,7 +90,7 @@ void ais_interrupt() {
       switch (rx_sync_state) {
           // SYNC STATE: RESET
           case PH_SYNC_RESET:                     // sub-state: (re)start sync process
-              if (rx_bit_count > PH_SYNC_TIMEOUT) {// if we exceeded sync time out
+              if (rx_bit_count > ph_sync_timeout) {// if we exceeded sync time out
                   ph_state = PH_STATE_RESET;      // reset state machine, will trigger channel hop
               }
               else {                              // else
@@ -132,6 +139,8 @@ void ais_interrupt() {
                   if (!rx_bit) {								// we expect a 0
                       rx_bit_count = 0;							// reset bit counter
                       ph_state = PH_STATE_PREFETCH;				// next state: start receiving packet
+                      rxevent_sync();
+                      fifo_mark_sync();
                   } else										// 1 is an error
                       rx_sync_state = PH_SYNC_RESET;				// restart preamble detection
               }
@@ -198,11 +207,89 @@ void ais_interrupt() {
       break;
   }
   // END OF PACKET HANDLER STATE MACHINE
+}
+
+void ais_interrupt() {
+  uint8_t rx_this_bit_NRZI;           // current bit for NRZI decoding
+
+  BENCH_ENTER(BENCH_AIS_OFF + ph_state);
+
+  // read data bit
+  rx_this_bit_NRZI = digitalRead(radio_data) ? 1 : 0;
+  capture_bit(rx_this_bit_NRZI);                // pass raw bit on if raw capture is running
+  ph_process_bit(rx_this_bit_NRZI);
 
   if (ph_state == PH_STATE_RESET) {   // if next state is reset
     ph_radio_channel ^= 1;          // toggle radio channel between 0 and 1
     radio_rx(ph_radio_channel);    // initiate channel hop
   }
+  BENCH_EXIT();
+}
+
+void ais_process_byte(uint8_t data) {
+  // decode 8 raw NRZI bits, first bit in LSB
+  BENCH_ENTER(BENCH_AIS_BYTE);
+  capture_bits(data);                           // pass raw bits on if raw capture is running
+  for (uint8_t i = 0; i < 8; i++) {
+    ph_process_bit(data & 1);
+    data >>= 1;
+    if (ph_state == PH_STATE_RESET) {  // if next state is reset, rest of byte was received on the old channel
+      ph_radio_channel ^= 1;          // toggle radio channel between 0 and 1
+      radio_rx(ph_radio_channel);    // initiate channel hop
+      break;                          // drop remaining bits
+    }
+  }
+  // hop at the end of this byte rather than a few bits into the next one, if
+  // the timeout is reached and no preamble is building up
+  if (ph_state == PH_STATE_WAIT_FOR_SYNC && rx_bit_count > PH_SYNC_TIMEOUT - 8 &&
+      rx_sync_state != PH_SYNC_FLAG && rx_sync_count < PH_SYNC_EARLY_HOP) {
+    ph_state = PH_STATE_RESET;
+    ph_radio_channel ^= 1;
+    radio_rx(ph_radio_channel);
+  }
+  BENCH_EXIT();
+}
+
+void ais_sync(uint8_t channel) {
+  // radio found training sequence, its sync word ends in raw bits 10 i.e. a
+  // decoded 0, continue with start flag detection on the following bytes
+  ph_radio_channel = channel;                   // radio may have hopped by itself
+  fifo_new_packet();                            // reset fifo packet
+  fifo_write_byte(ph_radio_channel);            // indicate channel for this packet
+  rx_prev_bit_NRZI = 0;
+  rx_bit_count = 0;
+  rx_sync_count = PH_PREAMBLE_LENGTH + 1;       // preamble is long enough already
+  rx_sync_state = PH_SYNC_0;
+  ph_state = PH_STATE_WAIT_FOR_SYNC;
+}
+
+uint8_t ais_receiving() {
+  return ph_state != PH_STATE_OFF && ph_state != PH_STATE_RESET;
+}
+
+uint8_t ais_in_packet() {
+  return ph_state == PH_STATE_PREFETCH || ph_state == PH_STATE_RECEIVE_PACKET;
+}
+
+void ais_hop() {
+  ph_state = PH_STATE_RESET;          // drop packet in progress
+  ph_radio_channel ^= 1;              // toggle radio channel between 0 and 1
+  radio_rx(ph_radio_channel);         // initiate channel hop
+}
+
+void ais_preamble() {
+  // radio detected a preamble, give the decoder more time to find the start flag
+  if (ph_state == PH_STATE_WAIT_FOR_SYNC)
+    ph_sync_timeout = PH_SYNC_TIMEOUT_HOLD;
+}
+
+uint8_t ais_skip_channel() {
+  // radio found no preamble, hop unless the decoder sees one coming
+  if (ph_state != PH_STATE_WAIT_FOR_SYNC || rx_sync_state == PH_SYNC_FLAG ||
+      rx_sync_count > PH_SKIP_PREAMBLE)
+    return 0;
+  ais_hop();
+  return 1;
 }
 
 void ais_off() {
@@ -216,19 +303,19 @@ void ais_on() {
 void ais_print_state() {
   switch (ph_state){
     case PH_STATE_OFF:
-      Serial.println("STATE_OFF");
+      Serial.println(F("STATE_OFF"));
       break;
     case PH_STATE_RESET:
-      Serial.println("STATE_RESET");
+      Serial.println(F("STATE_RESET"));
       break;
     case PH_STATE_WAIT_FOR_SYNC:
-      Serial.println("STATE_WAIT_SYNC");
+      Serial.println(F("STATE_WAIT_SYNC"));
       break;
   case PH_STATE_PREFETCH:
-      Serial.println("STATE_PREFETCH");
+      Serial.println(F("STATE_PREFETCH"));
       break;
   case PH_STATE_RECEIVE_PACKET:
-      Serial.println("STATE_RX_PACKET");
+      Serial.println(F("STATE_RX_PACKET"));
       break;
   }
 }
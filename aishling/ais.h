@@ -1,7 +1,14 @@
 void ph_setup(void);				// setup packet handler, e.g. configuring input pins
 void ph_start(void);				// start receiving packages
 void ph_stop(void);					// stop receiving packages
-void ais_interrupt();
+void ais_interrupt();				// bit-clock interrupt, decodes every bit
+void ais_process_byte(uint8_t data);	// decode 8 raw NRZI bits from the radio FIFO, first bit in LSB
+void ais_sync(uint8_t channel);		// preamble found by radio on channel, decode from the next byte on
+uint8_t ais_receiving();			// 1 while the decoder takes bits, i.e. not hopping
+uint8_t ais_in_packet();			// 1 between start flag and end of packet
+void ais_hop();						// abort reception and change channel
+void ais_preamble();				// radio detected preamble, wait longer for start flag
+uint8_t ais_skip_channel();			// radio found no preamble, hop if decoder agrees, 1 if hopped
 void ais_print_state();
 void ais_off();
 void ais_on();
@@ -5,14 +5,32 @@
 #include "ais.h"
 #include "fifo.h"
 #include "nmea.h"
+#include "capture.h"
+#include "payload.h"
+#include "targets.h"
+#include "filter.h"
+#include "rxfifo.h"
+#include "rxevent.h"
+#include "health.h"
+#include "survey.h"
+#include "latency.h"
+#include "power.h"
+#include "ram.h"
+#include "bench.h"
 
 ////////////////////////////////////////////////////////////////////////////// 
 // Setup
 //////////////////////////////////////////////////////////////////////////////
 void setup() {
+  ram_paint();
   ais_setup();
+  power_setup();
+  targets_reset();
+  filter_reset();
   
-  while (!Serial);
+#ifndef AIS_BENCH
+  while (!Serial);  // no USB host in simulator
+#endif
   // Give USB terminal time to start up
   startup_message();
   // Set up radio
@@ -29,6 +47,12 @@ void setup() {
   
   // Connect AIS decoder
   TXLED1; // Green
+  clock_attach();
+  rxevent_start();
+  BENCH_ENTER(BENCH_READY);
+}
+
+void clock_attach() {
   attachInterrupt(
     digitalPinToInterrupt(radio_clock),
     ais_interrupt,
@@ -38,26 +62,72 @@ void setup() {
 
 void startup_message() {
   // Startup message
-  Serial.println("$PAIS, AIShling: AIS receiver                   *60");
-  Serial.println("$PAIS, http://github.com/going-digital/AIShling *4F");
+  Serial.println(F("$PAIS, AIShling: AIS receiver                   *60"));
+  Serial.println(F("$PAIS, http://github.com/going-digital/AIShling *4F"));
   //Serial.println();
   //Serial.println("h: help");
   //Serial.println("e: AIS state");
   //Serial.println("f: Radio crystal finetune");
   //Serial.println("q: Enable oscillator output");
   //Serial.println("w: Disable oscillator output");
+  //Serial.println("r/R: Raw capture on channel A/B");
+  //Serial.println("n: NMEA output");
+  //Serial.println("t: Target table");
+  //Serial.println("T: Toggle target summary output");
+  //Serial.println("F<rule>: Add filter rule, F: list rules");
+  //Serial.println("p: Toggle radio packet handler mode");
+  //Serial.println("s: Statistics");
+  //Serial.println("v: Toggle RSSI survey");
+  //Serial.println("l: Latency histograms, L: clear them");
+  //Serial.println("m: RAM use");
 }
 
 ////////////////////////////////////////////////////////////////////////////// 
 // Loop
 //////////////////////////////////////////////////////////////////////////////
+char command_args[24];      // arguments of multi-character command
+uint8_t command_length;     // number of characters in command_args
+uint8_t command_pending;    // command waiting for end of line, 0 if none
+
+void command_execute() {
+  switch (command_pending) {
+    case 'F':
+      filter_command(command_args);
+      break;
+  }
+}
+
 void loop() {
+  power_idle();
   if (fifo_get_packet()) {
-    nmea_process_packet();
+    latency_dequeue();
+    ais_payload payload;
+    if (fifo_packet_payload(payload)) {
+      uint8_t channel = fifo_read_byte();
+      ais_report report;
+      if (ais_parse(payload, report))
+        targets_update(report);
+      if (!targets_summary_enabled() && filter_packet(channel, payload))
+        nmea_process_packet();
+    }
     fifo_remove_packet();
+    latency_done();
   }
+  targets_poll();
+  capture_process();
+  health_poll();
+  survey_poll();
   if (Serial.available()) {
     uint8_t c = Serial.read();
+    if (command_pending) {  // collect arguments until end of line
+      if (c == '\r' || c == '\n') {
+        command_args[command_length] = 0;
+        command_execute();
+        command_pending = 0;
+      } else if (command_length < sizeof(command_args) - 1)
+        command_args[command_length++] = c;
+      return;
+    }
     switch (c) {
       case 'h': // Help message
         startup_message();
@@ -72,11 +142,68 @@ void loop() {
         break;
       case 'q':
         radio_test_clock(true);
-        Serial.println("30MHz test output on NIRQ enabled");
+        Serial.println(F("30MHz test output on NIRQ enabled"));
         break;
       case 'w':
         radio_test_clock(false);
-        Serial.println("30MHz test output on NIRQ disabled");
+        Serial.println(F("30MHz test output on NIRQ disabled"));
+        break;
+      case 'r': // Raw bitstream capture on channel A
+      case 'R': // Raw bitstream capture on channel B
+        if (rxfifo_enabled())   // radio only passes bits after a sync and hops by itself
+          Serial.println(F("Capture needs packet handler mode off"));
+        else
+          capture_start(c == 'R');
+        break;
+      case 'n': // Back to NMEA output
+        capture_stop();
+        break;
+      case 't': // Dump target table
+        targets_dump();
+        break;
+      case 'T': // Toggle summary only output
+        targets_summary(!targets_summary_enabled());
+        break;
+      case 'v': // Toggle RSSI survey
+        if (survey_enabled()) {
+          survey_stop();
+          Serial.println(F("Survey off"));
+        } else {
+          survey_start();
+          Serial.println(F("Survey on"));
+        }
+        break;
+      case 'l': // Latency histograms
+        latency_dump();
+        break;
+      case 'L':
+        latency_reset();
+        break;
+      case 'm': // RAM use
+        ram_stats();
+        break;
+      case 's': // Statistics
+        rxevent_stats();
+        health_stats();
+        power_stats();
+        break;
+      case 'p': // Toggle Si4463 packet handler mode
+        if (capture_enabled()) {
+          Serial.println(F("Packet handler mode needs capture off"));
+        } else if (rxfifo_enabled()) {
+          rxfifo_stop();
+          clock_attach();
+          rxevent_start();
+          Serial.println(F("Packet handler mode off"));
+        } else {
+          detachInterrupt(digitalPinToInterrupt(radio_clock));
+          rxfifo_start();
+          Serial.println(F("Packet handler mode on"));
+        }
+        break;
+      case 'F': // Filter rule, arguments follow until end of line
+        command_pending = c;
+        command_length = 0;
         break;
 
       default:
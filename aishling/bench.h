@@ -0,0 +1,39 @@
+/*
+ * Benchmark markers for cycle counting under simavr (host/simbench).
+ * Built with -DAIS_BENCH, every instrumented section writes its id to GPIOR0
+ * on entry and BENCH_LEAVE on exit, the simulator times the writes. Without
+ * AIS_BENCH the markers compile to nothing.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+enum BENCH_ID {
+  BENCH_LEAVE = 0,              // end of innermost section
+  BENCH_AIS_OFF,                // ais_interrupt(), by state on entry
+  BENCH_AIS_RESET,
+  BENCH_AIS_WAIT_FOR_SYNC,
+  BENCH_AIS_PREFETCH,
+  BENCH_AIS_RECEIVE_PACKET,
+  BENCH_AIS_BYTE,               // ais_process_byte(), 8 bits from the radio FIFO
+  BENCH_NMEA_PACKET,            // nmea_process_packet()
+  BENCH_NMEA_SENTENCE,          // one sentence within nmea_process_packet()
+  BENCH_FIFO_NEW_PACKET,
+  BENCH_FIFO_WRITE_BYTE,
+  BENCH_FIFO_COMMIT_PACKET,
+  BENCH_FIFO_GET_PACKET,
+  BENCH_FIFO_READ_BYTE,
+  BENCH_FIFO_REMOVE_PACKET,
+  BENCH_RADIO_RX,               // radio_rx(), one channel hop
+  BENCH_READY = 0xff            // setup() finished, simulator starts bit clock
+};
+
+#ifdef AIS_BENCH
+#include <avr/io.h>
+#define BENCH_ENTER(id) (GPIOR0 = (id))
+#define BENCH_EXIT()    (GPIOR0 = BENCH_LEAVE)
+#else
+#define BENCH_ENTER(id)
+#define BENCH_EXIT()
+#endif
+
+#endif
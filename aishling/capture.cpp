@@ -0,0 +1,168 @@
+/*
+ * Raw bitstream capture. Packs raw NRZI bits from the bit-clock interrupt, or
+ * bytes of 8 bits from the radio FIFO, into blocks and streams them as
+ * binary frames through UART for host-side decoding.
+ *
+ * Frame layout (multi-byte values little endian):
+ *   0  0xA5 0x5A    sync
+ *   2  sequence     uint16, incremented for every block, also for dropped ones
+ *   4  channel      uint8, 0=A, 1=B
+ *   5  size         uint8, number of data bytes
+ *   6  timestamp    uint32, micros() when first bit of block arrived
+ *   10 data         raw NRZI bits, first received bit in LSB of first byte
+ *   .. check        uint8, XOR of all bytes from sequence to end of data
+ */
+
+#include "Arduino.h"
+#include "radio.h"
+#include "ais.h"
+#include "capture.h"
+
+#define CAPTURE_SYNC_0      0xA5
+#define CAPTURE_SYNC_1      0x5A
+#define CAPTURE_BLOCK_SIZE  16    // data bytes per block, 16 bytes = 128 bits = 13.3ms at 9600 bit/s
+#define CAPTURE_BLOCKS      4     // number of blocks buffered for UART (must be 2^x)
+#define CAPTURE_BLOCK_MASK  (CAPTURE_BLOCKS - 1)
+#define CAPTURE_BYTE_DELAY  729   // time from first to last bit of a byte in us, 7 bits at 9600 bit/s
+
+struct capture_block {
+  uint16_t sequence;
+  uint8_t channel;
+  uint8_t size;
+  uint32_t timestamp;
+  uint8_t data[CAPTURE_BLOCK_SIZE];
+};
+
+capture_block capture_blocks[CAPTURE_BLOCKS];     // ring of blocks waiting for UART
+volatile uint8_t capture_block_in;                // ring index of block being filled
+uint8_t capture_block_out;                        // ring index of next block to send
+
+volatile uint8_t capture_active = 0;              // 1 while capture is running
+uint8_t capture_channel;                          // channel being captured
+uint16_t capture_sequence;                        // sequence number of block being filled
+uint8_t capture_byte;                             // shift register for incoming bits
+uint32_t capture_timestamp;                       // micros() of first bit of current block
+uint8_t capture_bit_count;                        // bits in shift register
+uint8_t capture_byte_count;                       // bytes in current block
+uint8_t capture_dropping;                         // 1 if current block is discarded, UART too slow
+uint16_t capture_overruns;                        // number of discarded blocks
+
+void capture_start(uint8_t channel)
+{
+  ais_off();                                      // decoder would hop channels, stop it
+  capture_active = 0;
+  capture_channel = channel;
+  capture_block_in = 0;
+  capture_block_out = 0;
+  capture_sequence = 0;
+  capture_bit_count = 0;
+  capture_byte_count = 0;
+  capture_dropping = 0;
+  capture_overruns = 0;
+  radio_rx(channel);                              // stay on selected channel
+  capture_active = 1;
+}
+
+void capture_stop(void)
+{
+  capture_active = 0;
+  ais_on();
+}
+
+uint8_t capture_enabled(void)
+{
+  return capture_active;
+}
+
+void capture_retune(void)
+{
+  radio_rx(capture_channel);
+}
+
+static void capture_store(uint8_t data)
+{
+  // add byte of 8 raw bits to current block
+  if (capture_byte_count == 0) {                  // first byte of a new block
+    uint8_t in = capture_block_in;
+    // discard block if ring is full, sequence number will still show the gap
+    capture_dropping = ((in - capture_block_out) & 0xff) >= CAPTURE_BLOCKS;
+    if (!capture_dropping) {
+      capture_block *block = &capture_blocks[in & CAPTURE_BLOCK_MASK];
+      block->sequence = capture_sequence;
+      block->channel = capture_channel;
+      block->timestamp = capture_timestamp;
+    }
+  }
+
+  if (!capture_dropping)
+    capture_blocks[capture_block_in & CAPTURE_BLOCK_MASK].data[capture_byte_count] = data;
+  if (++capture_byte_count < CAPTURE_BLOCK_SIZE)
+    return;
+
+  // block complete
+  capture_byte_count = 0;
+  if (capture_dropping)
+    capture_overruns++;
+  else {
+    capture_blocks[capture_block_in & CAPTURE_BLOCK_MASK].size = CAPTURE_BLOCK_SIZE;
+    capture_block_in++;                           // hand block over to capture_process()
+  }
+  capture_sequence++;
+}
+
+void capture_bit(uint8_t bit)
+{
+  if (!capture_active)
+    return;
+
+  if (capture_bit_count == 0 && capture_byte_count == 0)      // first bit of a new block
+    capture_timestamp = micros();
+
+  capture_byte >>= 1;                             // shift in bit, LSB first
+  if (bit)
+    capture_byte |= 0x80;
+  if (++capture_bit_count < 8)
+    return;
+
+  capture_bit_count = 0;
+  capture_store(capture_byte);
+}
+
+void capture_bits(uint8_t data)
+{
+  if (!capture_active)
+    return;
+
+  if (capture_byte_count == 0)                    // first byte of a new block, first bit arrived 7 bits ago
+    capture_timestamp = micros() - CAPTURE_BYTE_DELAY;
+  capture_store(data);
+}
+
+void capture_process(void)
+{
+  while (capture_block_out != capture_block_in) {
+    capture_block *block = &capture_blocks[capture_block_out & CAPTURE_BLOCK_MASK];
+    uint8_t header[10];
+    header[0] = CAPTURE_SYNC_0;
+    header[1] = CAPTURE_SYNC_1;
+    header[2] = block->sequence & 0xff;
+    header[3] = block->sequence >> 8;
+    header[4] = block->channel;
+    header[5] = block->size;
+    header[6] = block->timestamp & 0xff;
+    header[7] = (block->timestamp >> 8) & 0xff;
+    header[8] = (block->timestamp >> 16) & 0xff;
+    header[9] = block->timestamp >> 24;
+
+    uint8_t check = 0;
+    for (uint8_t i = 2; i < sizeof(header); i++)
+      check ^= header[i];
+    for (uint8_t i = 0; i < block->size; i++)
+      check ^= block->data[i];
+
+    Serial.write(header, sizeof(header));
+    Serial.write(block->data, block->size);
+    Serial.write(check);
+    capture_block_out++;                          // release block to interrupt
+  }
+}
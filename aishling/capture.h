@@ -0,0 +1,7 @@
+void capture_start(uint8_t channel);	// stop decoder, tune to channel and stream raw NRZI bits over USB
+void capture_stop(void);				// stop streaming and restart decoder
+uint8_t capture_enabled(void);			// 1 while capture is running
+void capture_retune(void);				// back to capture channel after the radio was reset
+void capture_bit(uint8_t bit);			// add raw NRZI bit to current block, called from bit-clock interrupt
+void capture_bits(uint8_t data);		// add 8 raw NRZI bits (first bit in LSB) to current block, called from the FIFO byte decoder
+void capture_process(void);				// send completed blocks through UART, called from loop()
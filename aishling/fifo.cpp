@@ -1,8 +1,10 @@
 #include "Arduino.h"
 #include "fifo.h"
+#include "payload.h"
+#include "bench.h"
 
-#define FIFO_BUFFER_SIZE 256 // size of FIFO in bytes (must be 2^x)
-#define FIFO_PACKETS     8   // max number of individual packets in FIFO (must be 2^x, should be approx. FIFO_BUFFER_SIZE/avg message size)
+#define FIFO_BUFFER_SIZE 512 // size of FIFO in bytes (must be 2^x)
+#define FIFO_PACKETS     16  // max number of individual packets in FIFO (must be 2^x, should be approx. FIFO_BUFFER_SIZE/avg message size)
 
 #if (FIFO_BUFFER_SIZE > 256) // determine smallest data type required to hold FIFO pointers
 #define FIFO_PTR_TYPE	uint16_t // 16 bit for FIFO larger than 256 bytes
@@ -12,20 +14,31 @@
 
 #define FIFO_BUFFER_MASK (FIFO_BUFFER_SIZE - 1)		// mask for easy warping of buffer
 #define FIFO_PACKET_MASK (FIFO_PACKETS - 1)			// mask for easy warping of packet table
+#define FIFO_AIR_TIME_SHIFT 3						// air time in 8us, micros() steps at 8MHz, up to 524ms
 
 uint8_t fifo_buffer[FIFO_BUFFER_SIZE];				// buffer to hold packet data
 FIFO_PTR_TYPE fifo_packets[FIFO_PACKETS];			// table with start offsets of received packets
 
 FIFO_PTR_TYPE fifo_bytes_in;						// counter for bytes written into current packet
+FIFO_PTR_TYPE fifo_bytes_free;						// known free space for current packet, updated when exhausted
+uint8_t fifo_overflow;								// current packet did not fit into FIFO
+volatile uint16_t fifo_overflows;					// number of packets dropped because FIFO was full
 FIFO_PTR_TYPE fifo_bytes_out;						// counter for bytes read from current packet
 volatile uint8_t fifo_packet_in;					// table index of incoming packet
 uint8_t fifo_packet_out;							// table index of outgoing packet
 
+uint32_t fifo_sync_time;							// micros() of start flag of incoming packet
+uint16_t fifo_air_times[FIFO_PACKETS];				// start flag to end flag in units of 8us, per packet
+uint32_t fifo_commit_times[FIFO_PACKETS];			// micros() of end flag, per packet
+
 void fifo_reset(void)
 {
   // reset FIFO
   fifo_bytes_in = 0;
   fifo_bytes_out = 0;
+  fifo_bytes_free = 0;
+  fifo_overflow = 0;
+  fifo_overflows = 0;
   fifo_packet_in = 0;
   fifo_packet_out = 0;
   fifo_packets[0] = 0;							// ensure valid entry for first packet
@@ -34,50 +47,145 @@ void fifo_reset(void)
 void fifo_new_packet(void)
 {
   // reset offset to (re)start packet
+  BENCH_ENTER(BENCH_FIFO_NEW_PACKET);
   fifo_bytes_in = 0;
+  fifo_bytes_free = 0;							// force recalculation of free space
+  fifo_overflow = 0;
+  BENCH_EXIT();
+}
+
+void fifo_mark_sync(void)
+{
+  // remember time of start flag for latency tracing
+  fifo_sync_time = micros();
+}
+
+FIFO_PTR_TYPE fifo_free(void)
+{
+  // calculate space between start of incoming packet and start of oldest unread packet
+  if (fifo_packet_in == fifo_packet_out)			// if FIFO is empty
+    return FIFO_BUFFER_SIZE - 1;					// all but one byte, size of packet must stay < FIFO_BUFFER_SIZE
+  return (fifo_packets[fifo_packet_out] - fifo_packets[fifo_packet_in]) & FIFO_BUFFER_MASK;
 }
 
 void fifo_write_byte(uint8_t data)
 {
   // add byte to the incoming packet
+  BENCH_ENTER(BENCH_FIFO_WRITE_BYTE);
+  if (fifo_bytes_in >= fifo_bytes_free) {			// if known free space is used up
+    fifo_bytes_free = fifo_free();					// check again, packets may have been removed since
+    if (fifo_bytes_in >= fifo_bytes_free) {		// if FIFO is really full
+      fifo_overflow = 1;							// drop packet on commit
+      BENCH_EXIT();
+      return;
+    }
+  }
   FIFO_PTR_TYPE position = (fifo_packets[fifo_packet_in] + fifo_bytes_in) & FIFO_BUFFER_MASK;		// calculate position in buffer
   fifo_buffer[position] = data;					// store byte at position
   fifo_bytes_in++;								// increase byte counter
+  BENCH_EXIT();
 }
 
 void fifo_commit_packet(void)
 {
   // complete incoming packet by advancing to next slot in FIFO
+  BENCH_ENTER(BENCH_FIFO_COMMIT_PACKET);
+  if (fifo_overflow || ((fifo_packet_in + 1) & FIFO_PACKET_MASK) == fifo_packet_out) {	// if packet or packet table did not fit
+    fifo_overflows++;								// count lost packet
+    fifo_new_packet();								// and restart packet
+    BENCH_EXIT();
+    return;
+  }
+  uint32_t now = micros();						// timestamps travel with the packet
+  uint32_t air_time = (now - fifo_sync_time) >> FIFO_AIR_TIME_SHIFT;
+  fifo_air_times[fifo_packet_in] = air_time > 0xffff ? 0xffff : air_time;
+  fifo_commit_times[fifo_packet_in] = now;
   FIFO_PTR_TYPE new_position = (fifo_packets[fifo_packet_in] + fifo_bytes_in) & FIFO_BUFFER_MASK;	// calculate position in buffer for next packet
   fifo_packet_in = (fifo_packet_in + 1) & FIFO_PACKET_MASK;
   fifo_packets[fifo_packet_in] = new_position;	// store new position in packet table
   fifo_bytes_in = 0;								// reset offset to be ready to store data
+  fifo_bytes_free = 0;							// force recalculation of free space
+  BENCH_EXIT();
 }
 
 uint16_t fifo_get_packet(void)
 {
   // if available, initiate reading from packet from FIFO
-  if (fifo_packet_in == fifo_packet_out)			// if no packets are in FIFO
-  return 0;									// return 0
+  BENCH_ENTER(BENCH_FIFO_GET_PACKET);
+  if (fifo_packet_in == fifo_packet_out) {		// if no packets are in FIFO
+    BENCH_EXIT();
+    return 0;									// return 0
+  }
 
   fifo_bytes_out = 0;								// reset read offset within current packet
 
   // calculate and size of available packet
   FIFO_PTR_TYPE next_packet = (fifo_packet_out + 1) & FIFO_PACKET_MASK;
-  return (FIFO_BUFFER_SIZE -	fifo_packets[fifo_packet_out] + fifo_packets[next_packet]) & FIFO_BUFFER_MASK;
+  uint16_t size = (FIFO_BUFFER_SIZE -	fifo_packets[fifo_packet_out] + fifo_packets[next_packet]) & FIFO_BUFFER_MASK;
+  BENCH_EXIT();
+  return size;
 }
 
 uint8_t fifo_read_byte(void)
 {
   // retrieve byte from current packet
+  BENCH_ENTER(BENCH_FIFO_READ_BYTE);
   FIFO_PTR_TYPE position = (fifo_packets[fifo_packet_out] + fifo_bytes_out) & FIFO_BUFFER_MASK;	// calculate current read position
   fifo_bytes_out++;								// increase current read offset
-  return fifo_buffer[position];					// return byte from calculated position
+  uint8_t data = fifo_buffer[position];			// read byte from calculated position
+  BENCH_EXIT();
+  return data;
+}
+
+const uint8_t *fifo_packet_buffer(uint16_t *offset, uint16_t *mask)
+{
+  // direct access to current packet for zero-copy parsing, bytes wrap at mask
+  *offset = fifo_packets[fifo_packet_out];
+  *mask = FIFO_BUFFER_MASK;
+  return fifo_buffer;
+}
+
+bool fifo_packet_payload(ais_payload &payload)
+{
+  // describe AIS payload of current packet, i.e. without channel byte and CRC
+  uint16_t size = fifo_get_packet();
+  if (size < 4)									// channel, at least one payload byte and CRC
+    return false;
+  payload.buffer = fifo_buffer;
+  payload.start = fifo_packets[fifo_packet_out] + 1;
+  payload.mask = FIFO_BUFFER_MASK;
+  payload.bits = (size - 3) * 8;
+  return true;
+}
+
+void fifo_packet_times(uint32_t *sync, uint32_t *commit)
+{
+  // start flag and end flag time of current packet
+  *commit = fifo_commit_times[fifo_packet_out];
+  *sync = *commit - ((uint32_t)fifo_air_times[fifo_packet_out] << FIFO_AIR_TIME_SHIFT);
 }
 
 void fifo_remove_packet(void)
 {
   // remove packet from FIFO, advance to next slot
+  BENCH_ENTER(BENCH_FIFO_REMOVE_PACKET);
   if(fifo_packet_in != fifo_packet_out)			// but only do so, if there's actually a packet available
   fifo_packet_out = (fifo_packet_out + 1) & FIFO_PACKET_MASK;
+  BENCH_EXIT();
+}
+
+uint8_t fifo_packet_count(void)
+{
+  // number of committed packets waiting to be read
+  return (fifo_packet_in - fifo_packet_out) & FIFO_PACKET_MASK;
+}
+
+uint16_t fifo_overflow_count(void)
+{
+  // number of packets lost since reset
+  uint16_t count;
+  noInterrupts();
+  count = fifo_overflows;
+  interrupts();
+  return count;
 }
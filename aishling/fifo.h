@@ -1,9 +1,18 @@
+struct ais_payload;
+
 void fifo_reset(void);					// reset FIFO, all unread data is lost
 
 void fifo_new_packet(void);				// start a new packet, discards any non-committed data
+void fifo_mark_sync(void);				// record time of start flag of incoming packet
 void fifo_write_byte(uint8_t data);		// add next byte to current packet
 void fifo_commit_packet(void);			// commit data of current packet, starts a new packet
 
 uint16_t fifo_get_packet(void);			// start reading packet from FIFO, returns size of packet, 0=no packet available
 uint8_t fifo_read_byte(void);			// read next byte from current packet
+const uint8_t *fifo_packet_buffer(uint16_t *offset, uint16_t *mask);	// buffer and offset of current packet, for reading without copying
+bool fifo_packet_payload(ais_payload &payload);	// describe AIS payload of current packet for parsing, false if none
+void fifo_packet_times(uint32_t *sync, uint32_t *commit);	// micros() of start and end flag of current packet
 void fifo_remove_packet(void);			// remove packet from FIFO, advance to next slot
+
+uint8_t fifo_packet_count(void);		// number of packets waiting in FIFO
+uint16_t fifo_overflow_count(void);		// number of packets dropped because FIFO was full
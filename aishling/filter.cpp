@@ -0,0 +1,209 @@
+/*
+ * Message filter. Decides per packet whether it is sent as NMEA, based on
+ * rules for message type, MMSI and channel. Rules are checked in the order
+ * they were added, the first matching rule decides, packets matching no rule
+ * are sent. Only the first 38 payload bits are read, no armoring needed.
+ *
+ * Rules are configured with the F command, one rule per line:
+ *   F+t1-3         allow message types 1 to 3
+ *   F-t24          deny message type 24
+ *   F-m244000000-244999999 deny MMSI range
+ *   F-cB           deny channel B
+ *   F~m0-999999999/30      send each MMSI at most every 30 seconds
+ *   Fc             clear all rules
+ *   F              list rules as $PAIS,FLT,<n>,<rule>,<low>,<high>,<interval>,<hits>
+ *                  followed by $PAIS,FLT,default,<hits>,<evictions>
+ * A rule that does not parse completely is answered with $PAIS,FLT,error.
+ *
+ * Decimation remembers the last FILTER_MMSI_SLOTS vessels it sent. With more
+ * vessels, the one sent longest ago makes room; if its interval has not run
+ * out yet it counts as an eviction and its next message is sent early.
+ */
+
+#include "Arduino.h"
+#include "payload.h"
+#include "nmea.h"
+#include "filter.h"
+
+#define FILTER_RULES        8     // max number of rules
+#define FILTER_MMSI_SLOTS   16    // size of last forwarded table for decimation, searched linearly
+
+enum FILTER_ACTION {
+  FILTER_ALLOW = '+',
+  FILTER_DENY = '-',
+  FILTER_DECIMATE = '~'           // allow, but limit rate per MMSI
+};
+
+enum FILTER_FIELD {
+  FILTER_TYPE = 't',
+  FILTER_MMSI = 'm',
+  FILTER_CHANNEL = 'c'
+};
+
+struct filter_rule {
+  uint8_t action;                 // FILTER_ACTION
+  uint8_t field;                  // FILTER_FIELD
+  uint32_t low;                   // matching range
+  uint32_t high;
+  uint16_t interval;              // seconds between packets of same MMSI for FILTER_DECIMATE
+  uint16_t hits;                  // packets matched by this rule
+};
+
+struct filter_forwarded {
+  uint32_t mmsi;
+  uint16_t time;                  // seconds, time packet of this MMSI was last sent
+};
+
+filter_rule filter_rules[FILTER_RULES];
+uint8_t filter_rule_count;
+uint16_t filter_default_hits;     // packets matching no rule
+uint16_t filter_evictions;        // decimation entries replaced within their interval
+filter_forwarded filter_last[FILTER_MMSI_SLOTS];
+
+void filter_reset(void)
+{
+  filter_rule_count = 0;
+  filter_default_hits = 0;
+  filter_evictions = 0;
+  for (uint8_t i = 0; i < FILTER_MMSI_SLOTS; i++)
+    filter_last[i].mmsi = 0;
+}
+
+// true if MMSI was not sent within interval, remembers time of this packet
+static bool filter_decimate(uint32_t mmsi, uint16_t interval)
+{
+  uint16_t now = millis() / 1000;
+  filter_forwarded *last = NULL;  // entry of this MMSI, else free or oldest entry
+  uint16_t oldest_age = 0;
+  for (uint8_t i = 0; i < FILTER_MMSI_SLOTS; i++) {
+    filter_forwarded *slot = &filter_last[i];
+    if (slot->mmsi == mmsi) {
+      if ((uint16_t)(now - slot->time) < interval)
+        return false;
+      last = slot;
+      break;
+    }
+    uint16_t age = slot->mmsi ? now - slot->time : 0xffff;
+    if (!last || age > oldest_age) {
+      last = slot;
+      oldest_age = age;
+    }
+  }
+  if (last->mmsi != mmsi && last->mmsi && (uint16_t)(now - last->time) < interval &&
+      filter_evictions != 0xffff)
+    filter_evictions++;           // more vessels than slots within the interval
+  last->mmsi = mmsi;
+  last->time = now;
+  return true;
+}
+
+bool filter_packet(uint8_t channel, const ais_payload &payload)
+{
+  uint32_t type = ais_get(payload, AIS_TYPE);
+  uint32_t mmsi = ais_get(payload, AIS_MMSI);
+
+  for (uint8_t i = 0; i < filter_rule_count; i++) {
+    filter_rule *rule = &filter_rules[i];
+    uint32_t value = rule->field == FILTER_TYPE ? type : rule->field == FILTER_MMSI ? mmsi : channel;
+    if (value < rule->low || value > rule->high)
+      continue;
+    if (rule->hits != 0xffff)
+      rule->hits++;
+    if (rule->action == FILTER_DECIMATE)
+      return filter_decimate(mmsi, rule->interval);
+    return rule->action == FILTER_ALLOW;
+  }
+  if (filter_default_hits != 0xffff)
+    filter_default_hits++;
+  return true;
+}
+
+// parse decimal number, or channel letter A/B for channel rules, false if there is none
+static bool filter_parse_value(const char **s, uint8_t field, uint32_t *value)
+{
+  if (field == FILTER_CHANNEL && (**s == 'A' || **s == 'B' || **s == 'a' || **s == 'b')) {
+    *value = (*(*s)++ & 0x1f) - 1;
+    return true;
+  }
+  if (**s < '0' || **s > '9')
+    return false;
+  *value = 0;
+  while (**s >= '0' && **s <= '9') {
+    uint8_t digit = *(*s)++ - '0';
+    if (*value > (0xffffffffUL - digit) / 10)
+      return false;               // more than 32 bits
+    *value = *value * 10 + digit;
+  }
+  return true;
+}
+
+static void filter_send_error(void)
+{
+  nmea_begin(F("FLT"));
+  nmea_push_string(F(",error"));
+  nmea_end();
+}
+
+// send rule as $PAIS,FLT sentence
+static void filter_send_rule(uint8_t index, const filter_rule &rule)
+{
+  char text[3] = {(char)rule.action, (char)rule.field, 0};
+  nmea_begin(F("FLT"));
+  nmea_push_number(index);
+  nmea_push_string(F(","));
+  nmea_push_string(text);
+  nmea_push_number(rule.low);
+  nmea_push_number(rule.high);
+  nmea_push_number(rule.interval);
+  nmea_push_number(rule.hits);
+  nmea_end();
+}
+
+void filter_command(const char *args)
+{
+  if (*args == 0) {               // list rules and default hits
+    for (uint8_t i = 0; i < filter_rule_count; i++)
+      filter_send_rule(i, filter_rules[i]);
+    nmea_begin(F("FLT"));
+    nmea_push_string(F(",default"));
+    nmea_push_number(filter_default_hits);
+    nmea_push_number(filter_evictions);
+    nmea_end();
+    return;
+  }
+
+  if (*args == 'c') {             // clear rules
+    filter_reset();
+    return;
+  }
+
+  filter_rule rule;
+  rule.action = *args++;
+  rule.field = *args++;
+  if ((rule.action != FILTER_ALLOW && rule.action != FILTER_DENY && rule.action != FILTER_DECIMATE) ||
+      (rule.field != FILTER_TYPE && rule.field != FILTER_MMSI && rule.field != FILTER_CHANNEL) ||
+      filter_rule_count == FILTER_RULES) {
+    filter_send_error();
+    return;
+  }
+  bool valid = filter_parse_value(&args, rule.field, &rule.low);
+  rule.high = rule.low;
+  if (valid && *args == '-') {
+    args++;
+    valid = filter_parse_value(&args, rule.field, &rule.high);
+  }
+  uint32_t interval = 0;
+  if (valid && *args == '/') {
+    args++;
+    valid = filter_parse_value(&args, 0, &interval);
+  }
+  if (!valid || *args || rule.high < rule.low || interval > 0xffff) {   // trailing garbage, empty range
+    filter_send_error();
+    return;
+  }
+  rule.interval = interval;
+  rule.hits = 0;
+  filter_rules[filter_rule_count] = rule;
+  filter_send_rule(filter_rule_count, rule);  // confirm rule
+  filter_rule_count++;
+}
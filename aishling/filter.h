@@ -0,0 +1,5 @@
+struct ais_payload;
+
+void filter_reset(void);								// remove all rules, forward everything
+bool filter_packet(uint8_t channel, const ais_payload &payload);	// true if packet should be sent
+void filter_command(const char *args);					// add, clear or list rules, see filter.cpp
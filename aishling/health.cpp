@@ -0,0 +1,140 @@
+/*
+ * Radio health monitor. Once a second the Si4463 is asked for its device
+ * state and pending chip status, and the time until it answers is measured.
+ * A radio that does not answer, answers slowly or is not receiving is reset
+ * through SDN, reconfigured and put back into RX in the current mode. At most
+ * HEALTH_ATTEMPTS re-initialisations are tried in a row, then the monitor
+ * backs off to one attempt per HEALTH_BACKOFF so a dead radio does not keep
+ * the receiver busy.
+ *
+ * Statistics sentence (times in ms unless noted):
+ *   $PAIS,RAD,<checks>,<faults>,<recoveries>,<reinits>,<downtime>,<down>,
+ *             <cts timeouts>,<command errors>,<cts max us>,<state>
+ * Downtime runs from detecting a fault to the first good check after it and
+ * includes a fault still in progress, <down> is 1 while it lasts.
+ */
+
+#include "Arduino.h"
+#include "radio.h"
+#include "ais.h"
+#include "nmea.h"
+#include "capture.h"
+#include "rxfifo.h"
+#include "rxevent.h"
+#include "health.h"
+
+#define HEALTH_INTERVAL     1000    // ms between checks
+#define HEALTH_BACKOFF      60000   // ms between checks after HEALTH_ATTEMPTS failed re-initialisations
+#define HEALTH_ATTEMPTS     3       // re-initialisations in a row before backing off
+#define HEALTH_CTS_LIMIT    1000    // us, slower answers count as fault
+
+#define RADIO_STATE_RX_TUNE 6       // briefly seen right after a channel hop
+#define CHIP_CMD_ERROR      0x08    // CHIP_PEND: command error
+
+uint32_t health_last;               // millis() of last check
+uint16_t health_checks;             // number of checks
+uint16_t health_faults;             // faults detected
+uint16_t health_recoveries;         // faults cleared by re-initialisation
+uint16_t health_reinits;            // re-initialisations, including failed ones
+uint16_t health_cmd_errors;         // command errors reported by radio
+uint16_t health_cts_max;            // us, slowest answer of a working radio
+uint32_t health_downtime;           // ms, sum over cleared faults
+uint32_t health_down_since;         // millis() when current fault was detected
+uint8_t health_down;                // 1 while radio is faulty
+uint8_t health_attempts;            // re-initialisations for current fault
+uint8_t health_state = 0xff;        // last device state
+
+static uint8_t health_check(void)
+{
+  // SPI is shared with the radio interrupts, keep them out for the few
+  // commands; each gives up after a short CTS wait if the radio is dead
+  uint8_t mask = radio_lock();
+  uint32_t start = micros();
+  uint8_t state = radio_device_state();
+  uint16_t cts = micros() - start;
+  uint8_t pending = state == 0xff ? 0 : radio_get_chip_status();
+  radio_unlock(mask);
+
+  health_checks++;
+  health_state = state;
+  if (state == 0xff)                          // no answer, time is meaningless
+    return 0;
+  if (pending & CHIP_CMD_ERROR)
+    health_cmd_errors++;                    // our mistake, not the radio's
+  if (cts > health_cts_max)
+    health_cts_max = cts;
+  return (state == RADIO_STATE_RX || state == RADIO_STATE_RX_TUNE) && cts < HEALTH_CTS_LIMIT;
+}
+
+static void health_reinit(void)
+{
+  // reset radio and restart reception in the mode it was in
+  health_reinits++;
+  detachInterrupt(digitalPinToInterrupt(radio_nirq));
+  ais_off();                                // bit-clock interrupt keeps off the SPI bus
+  if (!radio_setup())                       // SDN reset and configuration
+    return;                                 // stopped at first unanswered command, next check retries
+  if (rxfifo_enabled()) {
+    rxfifo_start();                         // packet handler configuration and NIRQ
+    return;
+  }
+  rxevent_start();
+  uint8_t mask = radio_lock();
+  if (capture_enabled())
+    capture_retune();
+  else
+    ais_hop();
+  radio_unlock(mask);
+}
+
+void health_poll(void)
+{
+  uint32_t now = millis();
+  if (now - health_last < (health_attempts < HEALTH_ATTEMPTS ? HEALTH_INTERVAL : HEALTH_BACKOFF))
+    return;
+  if (ais_in_packet())                      // a missed bit clock would lose the packet, check later
+    return;
+  health_last = now;
+  if (!health_check()) {
+    if (!health_down) {
+      health_down = 1;
+      health_down_since = now;
+      health_faults++;
+    }
+    health_reinit();
+    if (!health_check()) {
+      if (health_attempts < HEALTH_ATTEMPTS)
+        health_attempts++;
+      return;
+    }
+  }
+  if (health_down) {
+    health_down = 0;
+    health_attempts = 0;
+    health_recoveries++;
+    health_downtime += millis() - health_down_since;
+  }
+}
+
+void health_stats(void)
+{
+  noInterrupts();                           // counted in interrupts as well
+  uint16_t cts_timeouts = radio_cts_timeouts();
+  interrupts();
+  uint32_t downtime = health_downtime;
+  if (health_down)
+    downtime += millis() - health_down_since;
+
+  nmea_begin(F("RAD"));
+  nmea_push_number(health_checks);
+  nmea_push_number(health_faults);
+  nmea_push_number(health_recoveries);
+  nmea_push_number(health_reinits);
+  nmea_push_number(downtime);
+  nmea_push_number(health_down);
+  nmea_push_number(cts_timeouts);
+  nmea_push_number(health_cmd_errors);
+  nmea_push_number(health_cts_max);
+  nmea_push_number(health_state);
+  nmea_end();
+}
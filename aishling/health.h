@@ -0,0 +1,2 @@
+void health_poll(void);				// check radio every second, re-initialise it when stuck, called from loop()
+void health_stats(void);			// send radio health counters as $PAIS,RAD sentence
@@ -0,0 +1,132 @@
+/*
+ * Packet latency tracing. Each packet carries the time of its start flag and
+ * end flag through the FIFO, loop() adds the time it took the packet out,
+ * the NMEA encoder the time its first sentence was ready and the time the
+ * last sentence was handed to Serial. The stages
+ *   0: start flag to end flag (air time, or burst delay in packet handler mode,
+ *      kept in 8us steps up to 524ms)
+ *   1: end flag to dequeue in loop() (waiting in FIFO)
+ *   2: dequeue to first sentence encoded
+ *   3: first sentence encoded to last sentence written
+ *   4: end flag to last sentence written (total added by the receiver)
+ * are counted in log2 histograms. Packets that are not sent as NMEA, e.g.
+ * filtered or in summary mode, only count in stages 0 and 1.
+ *
+ * Report, times in us:
+ *   $PAIS,LAT,<stage>,<count>,<mean>,<max>
+ *   $PAIS,LTH,<stage>,<first bucket>,<count>,...     6 buckets per sentence
+ *   $PAIS,LTW,<stage 0>,<stage 1>,<stage 2>,<stage 3>,<stage 4>
+ * Bucket 0 holds times below 128us, bucket n times from 64us << n, the last
+ * bucket everything from 131ms. LTW lists the stages of the packet with the
+ * longest total.
+ */
+
+#include "Arduino.h"
+#include "fifo.h"
+#include "nmea.h"
+#include "latency.h"
+
+#define LATENCY_STAGES      5
+#define LATENCY_BUCKETS     12      // histogram buckets per stage
+#define LATENCY_BUCKETS_LINE 6      // buckets per $PAIS,LTH sentence, keeps it below 82 characters
+#define LATENCY_BASE_SHIFT  6       // bucket 0 ends at 128us
+
+#define LATENCY_TOTAL       4       // stage holding end flag to written
+
+struct latency_stage {
+  uint16_t count;
+  uint32_t sum;                     // us, for mean
+  uint32_t max;                     // us
+  uint16_t buckets[LATENCY_BUCKETS];
+};
+
+latency_stage latency_stages[LATENCY_STAGES];
+uint32_t latency_worst[LATENCY_STAGES];   // stages of packet with longest total
+
+uint32_t latency_sync;              // micros() of current packet's start flag
+uint32_t latency_commit;            // micros() of current packet's end flag
+uint32_t latency_deq;               // micros() when loop() took packet
+uint32_t latency_enc;               // micros() when first sentence was ready, 0 if none
+uint32_t latency_wr;                // micros() when last sentence was written, 0 if none
+
+static void latency_add(uint8_t stage, uint32_t time)
+{
+  latency_stage &s = latency_stages[stage];
+  if (s.count == 0xffff)
+    return;
+  s.count++;
+  s.sum += time;
+  if (time > s.max)
+    s.max = time;
+  uint8_t bucket = 0;
+  for (time >>= LATENCY_BASE_SHIFT + 1; time && bucket < LATENCY_BUCKETS - 1; time >>= 1)
+    bucket++;
+  s.buckets[bucket]++;
+}
+
+void latency_dequeue(void)
+{
+  fifo_packet_times(&latency_sync, &latency_commit);
+  latency_deq = micros();
+  latency_enc = 0;
+  latency_wr = 0;
+}
+
+void latency_encoded(void)
+{
+  latency_enc = micros();
+}
+
+void latency_written(void)
+{
+  latency_wr = micros();
+}
+
+void latency_done(void)
+{
+  uint32_t times[LATENCY_STAGES];
+  times[0] = latency_commit - latency_sync;
+  times[1] = latency_deq - latency_commit;
+  latency_add(0, times[0]);
+  latency_add(1, times[1]);
+  if (!latency_enc || !latency_wr)  // not sent as NMEA
+    return;
+  times[2] = latency_enc - latency_deq;
+  times[3] = latency_wr - latency_enc;
+  times[LATENCY_TOTAL] = latency_wr - latency_commit;
+  for (uint8_t stage = 2; stage < LATENCY_STAGES; stage++)
+    latency_add(stage, times[stage]);
+  if (times[LATENCY_TOTAL] > latency_worst[LATENCY_TOTAL])
+    memcpy(latency_worst, times, sizeof(latency_worst));
+}
+
+void latency_dump(void)
+{
+  for (uint8_t stage = 0; stage < LATENCY_STAGES; stage++) {
+    latency_stage &s = latency_stages[stage];
+    nmea_begin(F("LAT"));
+    nmea_push_number(stage);
+    nmea_push_number(s.count);
+    nmea_push_number(s.count ? s.sum / s.count : 0);
+    nmea_push_number(s.max);
+    nmea_end();
+    for (uint8_t first = 0; first < LATENCY_BUCKETS; first += LATENCY_BUCKETS_LINE) {
+      nmea_begin(F("LTH"));
+      nmea_push_number(stage);
+      nmea_push_number(first);
+      for (uint8_t i = first; i < first + LATENCY_BUCKETS_LINE; i++)
+        nmea_push_number(s.buckets[i]);
+      nmea_end();
+    }
+  }
+  nmea_begin(F("LTW"));
+  for (uint8_t stage = 0; stage < LATENCY_STAGES; stage++)
+    nmea_push_number(latency_worst[stage]);
+  nmea_end();
+}
+
+void latency_reset(void)
+{
+  memset(latency_stages, 0, sizeof(latency_stages));
+  memset(latency_worst, 0, sizeof(latency_worst));
+}
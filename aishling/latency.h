@@ -0,0 +1,6 @@
+void latency_dequeue(void);			// packet taken from FIFO in loop(), picks up its start and end flag time
+void latency_encoded(void);			// first NMEA sentence of packet is ready, called from nmea_process_packet()
+void latency_written(void);			// last NMEA sentence of packet handed to Serial
+void latency_done(void);			// packet finished, adds its times to the histograms
+void latency_dump(void);			// send histograms and worst case as $PAIS,LAT, LTH and LTW sentences
+void latency_reset(void);
@@ -9,25 +9,30 @@
 #include "Arduino.h"
 #include "fifo.h"
 #include "nmea.h"
+#include "bench.h"
+#include "latency.h"
 
 void nmea_push_char(char c);
+void nmea_put_char(char c);
+void nmea_flush(void);
+void nmea_end_line(void);
 uint8_t nmea_push_packet(uint8_t packet_size);
 
 #define NMEA_MAX_AIS_PAYLOAD 42		// number of AIS bytes per NMEA sentence, to keep total NMEA sentence always below 82 characters
 #define NMEA_AIS_BITS (NMEA_MAX_AIS_PAYLOAD * 8)
-#define NMEA_AIS_BITS_ENCODED ((NMEA_AIS_BITS + 5) / 6)
 
-const char nmea_lead[] = "!AIVDM,";             // static start of NMEA sentence
-char nmea_buffer[8+NMEA_AIS_BITS_ENCODED+5+1];  // buffer for dynamic part of NMEA sentence
-                                                // fragment and channel info, AIS payload, stuff-bit and crc, 0-termination
-uint8_t nmea_buffer_index;                      // current buffer position
+#define NMEA_CHUNK_SIZE 16          // bytes collected before handing them to Serial, sentences are streamed
+
+const char nmea_lead[] PROGMEM = "!AIVDM,";     // static start of NMEA sentence
+char nmea_chunk[NMEA_CHUNK_SIZE];               // output waiting for Serial
+uint8_t nmea_chunk_index;                       // current chunk position
 
 #define NMEA_LEAD_CRC 'A' ^ 'I' ^ 'V' ^ 'D' ^ 'M' ^ ',' // CRC for static start of sentence
 uint8_t nmea_crc; // calculated CRC
 
 uint8_t nmea_message_id = 0; // sequential message id for multi-sentence message
 
-const char nmea_hex[] = {
+const char nmea_hex[] PROGMEM = {
   '0', '1', '2', '3',		// lookup table for hex conversion of CRC
   '4', '5', '6', '7',
   '8', '9', 'A', 'B',
@@ -41,6 +46,7 @@ void nmea_process_packet(void)
 
   if (packet_size == 0 || packet_size < 4)    // check for empty packet
     return;                                 // no (valid) packet available in FIFO, nothing to send
+  BENCH_ENTER(BENCH_NMEA_PACKET);
 
   uint8_t radio_channel = fifo_read_byte() + 'A';	// retrieve radio channel (0=A, 1=B)
 
@@ -59,6 +65,7 @@ void nmea_process_packet(void)
   // avoid sending garbage if fragment count does not make sense
   if (total_fragments > 9)
   {
+    BENCH_EXIT();
     return;
   }
 
@@ -72,8 +79,10 @@ void nmea_process_packet(void)
 
   // create fragments
   while (packet_size > 0) {
-    // reset buffer and CRC
-    nmea_buffer_index = 0;
+    BENCH_ENTER(BENCH_NMEA_SENTENCE);
+    // write static start, CRC is known in advance
+    for (uint8_t i = 0; i < sizeof(nmea_lead) - 1; i++)
+      nmea_put_char(pgm_read_byte(&nmea_lead[i]));
     nmea_crc = NMEA_LEAD_CRC;
 
     // write fragment information, I assume total fragments always < 10
@@ -105,26 +114,97 @@ void nmea_process_packet(void)
     nmea_push_char(',');
     nmea_push_char(stuff_bits + '0');
 
-    // write CRC
-    uint8_t final_crc = nmea_crc;		// copy CRC as push_char will modify it
-    nmea_push_char('*');
-    nmea_push_char(nmea_hex[final_crc >> 4]);
-    nmea_push_char(nmea_hex[final_crc & 0x0f]);
+    // write CRC and end of line, send rest of sentence over UART
+    if (curr_fragment == 2)
+      latency_encoded();					// first sentence is encoded
+    nmea_end_line();
+    BENCH_EXIT();
+  }
+  latency_written();
+  BENCH_EXIT();
+}
 
-    // terminate message with 0
-    nmea_push_char(0);
+// sends collected chunk through UART
+void nmea_flush(void)
+{
+  Serial.write((const uint8_t *)nmea_chunk, nmea_chunk_index);
+  nmea_chunk_index = 0;
+}
 
-    // send NMEA sentence over UART
-    Serial.print(nmea_lead);
-    Serial.println(nmea_buffer);
-  }
+// adds char to output without updating CRC
+void nmea_put_char(char c)
+{
+  nmea_chunk[nmea_chunk_index++] = c;
+  if (nmea_chunk_index == NMEA_CHUNK_SIZE)
+    nmea_flush();
 }
 
-// adds char to buffer and updates CRC
+// adds char to output and updates CRC
 void nmea_push_char(char c)
 {
   nmea_crc ^= c;
-  nmea_buffer[nmea_buffer_index++] = c;
+  nmea_put_char(c);
+}
+
+// adds CRC and end of line, sends rest of sentence
+void nmea_end_line(void)
+{
+  uint8_t final_crc = nmea_crc;
+  nmea_put_char('*');
+  nmea_put_char(pgm_read_byte(&nmea_hex[final_crc >> 4]));
+  nmea_put_char(pgm_read_byte(&nmea_hex[final_crc & 0x0f]));
+  nmea_put_char('\r');
+  nmea_put_char('\n');
+  nmea_flush();
+}
+
+// start proprietary sentence $PAIS,<type>
+void nmea_begin(const __FlashStringHelper *type)
+{
+  nmea_put_char('$');
+  nmea_crc = 0;
+  nmea_push_string(F("PAIS,"));
+  nmea_push_string(type);
+}
+
+// add string
+void nmea_push_string(const char *s)
+{
+  while (*s)
+    nmea_push_char(*s++);
+}
+
+// add string from flash
+void nmea_push_string(const __FlashStringHelper *s)
+{
+  const char *p = (const char *)s;
+  char c;
+  while ((c = pgm_read_byte(p++)))
+    nmea_push_char(c);
+}
+
+// add comma and decimal number
+void nmea_push_number(int32_t value)
+{
+  char digits[11];
+  uint8_t count = 0;
+  uint32_t magnitude = value < 0 ? -(uint32_t)value : value;
+
+  nmea_push_char(',');
+  if (value < 0)
+    nmea_push_char('-');
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude);
+  while (count)
+    nmea_push_char(digits[--count]);
+}
+
+// add CRC and send sentence started with nmea_begin()
+void nmea_end(void)
+{
+  nmea_end_line();
 }
 
 // encodes and adds AIS packet to buffer, returns # of stuff bits
@@ -1,2 +1,8 @@
 
 void nmea_process_packet(void);			// create nmea sentences from current message in FIFO
+
+void nmea_begin(const __FlashStringHelper *type);	// start proprietary sentence $PAIS,<type>, type given with F()
+void nmea_push_string(const char *s);	// add text to sentence
+void nmea_push_string(const __FlashStringHelper *s);	// add text from flash to sentence
+void nmea_push_number(int32_t value);	// add comma and decimal number to sentence
+void nmea_end(void);					// add CRC and send sentence through UART
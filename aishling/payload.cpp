@@ -0,0 +1,96 @@
+/*
+ * AIS payload parser, see payload.h
+ */
+
+#include "payload.h"
+
+// read up to 32 bits starting at bit position start, MSB first
+uint32_t ais_get_bits(const ais_payload &payload, uint16_t start, uint8_t length)
+{
+  if (start + length > payload.bits)
+    return 0;
+
+  uint16_t index = payload.start + (start >> 3);
+  uint8_t available = 8 - (start & 7);            // usable bits in first byte
+  uint8_t byte = payload.buffer[index & payload.mask] & (0xff >> (start & 7));
+  uint32_t value = 0;
+
+  for (;;) {
+    if (available >= length)                      // last byte, drop bits behind field
+      return (value << length) | (byte >> (available - length));
+    value = (value << available) | byte;
+    length -= available;
+    index++;
+    byte = payload.buffer[index & payload.mask];
+    available = 8;
+  }
+}
+
+// copy position and motion fields if present and valid
+static void ais_parse_position(const ais_payload &payload, ais_report &report,
+                               const ais_field &lon, const ais_field &lat,
+                               const ais_field *sog, const ais_field *cog, const ais_field *second)
+{
+  if (ais_has(payload, lat)) {
+    report.lon = ais_get(payload, lon);
+    report.lat = ais_get(payload, lat);
+    if (report.lon != AIS_LON_NA && report.lat != AIS_LAT_NA)
+      report.flags |= AIS_HAS_POSITION;
+  }
+  if (sog && cog && ais_has(payload, *cog)) {
+    report.sog = ais_get(payload, *sog);
+    report.cog = ais_get(payload, *cog);
+    if (report.sog != AIS_SOG_NA && report.cog < AIS_COG_NA)
+      report.flags |= AIS_HAS_MOTION;
+  }
+  if (second && ais_has(payload, *second)) {
+    report.second = ais_get(payload, *second);
+    if (report.second < AIS_SECOND_NA)
+      report.flags |= AIS_HAS_SECOND;
+  }
+}
+
+bool ais_parse(const ais_payload &payload, ais_report &report)
+{
+  if (!ais_has(payload, AIS_MMSI))
+    return false;
+
+  report.type = ais_get(payload, AIS_TYPE);
+  report.mmsi = ais_get(payload, AIS_MMSI);
+  report.flags = 0;
+  report.lat = AIS_LAT_NA;
+  report.lon = AIS_LON_NA;
+  report.sog = AIS_SOG_NA;
+  report.cog = AIS_COG_NA;
+  report.second = AIS_SECOND_NA;
+
+  switch (report.type) {
+    case 1:
+    case 2:
+    case 3:
+      ais_parse_position(payload, report, AIS_1_LON, AIS_1_LAT, &AIS_1_SOG, &AIS_1_COG, &AIS_1_SECOND);
+      return true;
+    case 4:
+      ais_parse_position(payload, report, AIS_4_LON, AIS_4_LAT, 0, 0, &AIS_4_SECOND);
+      return true;
+    case 5:
+      report.flags |= AIS_HAS_STATIC;
+      return true;
+    case 18:
+      ais_parse_position(payload, report, AIS_18_LON, AIS_18_LAT, &AIS_18_SOG, &AIS_18_COG, &AIS_18_SECOND);
+      return true;
+    case 19:
+      ais_parse_position(payload, report, AIS_18_LON, AIS_18_LAT, &AIS_18_SOG, &AIS_18_COG, &AIS_18_SECOND);
+      report.flags |= AIS_HAS_STATIC;
+      return true;
+    case 21:
+      ais_parse_position(payload, report, AIS_21_LON, AIS_21_LAT, 0, 0, &AIS_21_SECOND);
+      report.flags |= AIS_HAS_STATIC;
+      return true;
+    case 24:
+      report.flags |= AIS_HAS_STATIC;
+      return true;
+    default:
+      return false;
+  }
+}
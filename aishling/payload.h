@@ -0,0 +1,129 @@
+/*
+ * AIS payload parser. Reads bit fields directly from packet bytes in the FIFO
+ * (or any other buffer) without copying. Field positions follow ITU-R M.1371.
+ */
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdint.h>
+
+// view on payload bytes, buffer may be a ring buffer
+struct ais_payload {
+  const uint8_t *buffer;          // buffer holding payload
+  uint16_t start;                 // offset of first payload byte in buffer
+  uint16_t mask;                  // buffer size - 1 for ring buffers, 0xffff for plain arrays
+  uint16_t bits;                  // payload length in bits
+};
+
+// bit field descriptor
+struct ais_field {
+  uint16_t start;                 // first bit, 0 = MSB of first payload byte
+  uint8_t length;                 // number of bits, up to 32, 6 per character for text
+  uint8_t is_signed;              // two's complement value
+};
+
+// all messages
+constexpr ais_field AIS_TYPE            = {0, 6, 0};
+constexpr ais_field AIS_REPEAT          = {6, 2, 0};
+constexpr ais_field AIS_MMSI            = {8, 30, 0};
+
+// types 1, 2, 3: class A position report
+constexpr ais_field AIS_1_STATUS        = {38, 4, 0};
+constexpr ais_field AIS_1_SOG           = {50, 10, 0};  // 0.1 knots, 1023 = n/a
+constexpr ais_field AIS_1_LON           = {61, 28, 1};  // 1/10000 minute, 181 deg = n/a
+constexpr ais_field AIS_1_LAT           = {89, 27, 1};  // 1/10000 minute, 91 deg = n/a
+constexpr ais_field AIS_1_COG           = {116, 12, 0}; // 0.1 degree, 3600 = n/a
+constexpr ais_field AIS_1_HEADING       = {128, 9, 0};  // degree, 511 = n/a
+constexpr ais_field AIS_1_SECOND        = {137, 6, 0};  // UTC second, 60 = n/a
+
+// type 4: base station report
+constexpr ais_field AIS_4_YEAR          = {38, 14, 0};
+constexpr ais_field AIS_4_MONTH         = {52, 4, 0};
+constexpr ais_field AIS_4_DAY           = {56, 5, 0};
+constexpr ais_field AIS_4_HOUR          = {61, 5, 0};
+constexpr ais_field AIS_4_MINUTE        = {66, 6, 0};
+constexpr ais_field AIS_4_SECOND        = {72, 6, 0};
+constexpr ais_field AIS_4_LON           = {79, 28, 1};
+constexpr ais_field AIS_4_LAT           = {107, 27, 1};
+
+// type 5: class A static and voyage data
+constexpr ais_field AIS_5_IMO           = {40, 30, 0};
+constexpr ais_field AIS_5_CALLSIGN      = {70, 42, 0};  // 7 characters
+constexpr ais_field AIS_5_NAME          = {112, 120, 0};// 20 characters
+constexpr ais_field AIS_5_SHIP_TYPE     = {232, 8, 0};
+constexpr ais_field AIS_5_DRAUGHT       = {294, 8, 0};  // 0.1m
+constexpr ais_field AIS_5_DESTINATION   = {302, 120, 0};// 20 characters
+
+// types 18, 19: class B position report, 19 adds static data
+constexpr ais_field AIS_18_SOG          = {46, 10, 0};
+constexpr ais_field AIS_18_LON          = {57, 28, 1};
+constexpr ais_field AIS_18_LAT          = {85, 27, 1};
+constexpr ais_field AIS_18_COG          = {112, 12, 0};
+constexpr ais_field AIS_18_HEADING      = {124, 9, 0};
+constexpr ais_field AIS_18_SECOND       = {133, 6, 0};
+constexpr ais_field AIS_19_NAME         = {143, 120, 0};
+constexpr ais_field AIS_19_SHIP_TYPE    = {263, 8, 0};
+
+// type 21: aid to navigation
+constexpr ais_field AIS_21_AID_TYPE     = {38, 5, 0};
+constexpr ais_field AIS_21_NAME         = {43, 120, 0};
+constexpr ais_field AIS_21_LON          = {164, 28, 1};
+constexpr ais_field AIS_21_LAT          = {192, 27, 1};
+constexpr ais_field AIS_21_SECOND       = {253, 6, 0};
+
+// type 24: class B static data, part A has name, part B ship type and call sign
+constexpr ais_field AIS_24_PART         = {38, 2, 0};
+constexpr ais_field AIS_24_NAME         = {40, 120, 0};
+constexpr ais_field AIS_24_SHIP_TYPE    = {40, 8, 0};
+constexpr ais_field AIS_24_CALLSIGN     = {90, 42, 0};
+
+#define AIS_LON_NA   (181L * 600000L)   // longitude not available
+#define AIS_LAT_NA   (91L * 600000L)    // latitude not available
+#define AIS_SOG_NA   1023
+#define AIS_COG_NA   3600
+#define AIS_SECOND_NA 60
+
+// report flags
+#define AIS_HAS_POSITION  0x01    // lat, lon valid
+#define AIS_HAS_MOTION    0x02    // sog, cog valid
+#define AIS_HAS_SECOND    0x04    // second valid
+#define AIS_HAS_STATIC    0x08    // message carries static data (name, call sign)
+
+// common fields of a parsed message
+struct ais_report {
+  uint8_t type;
+  uint8_t flags;                  // AIS_HAS_*
+  uint32_t mmsi;
+  int32_t lat;                    // 1/10000 minute
+  int32_t lon;                    // 1/10000 minute
+  uint16_t sog;                   // 0.1 knots
+  uint16_t cog;                   // 0.1 degree
+  uint8_t second;                 // UTC second of report
+};
+
+uint32_t ais_get_bits(const ais_payload &payload, uint16_t start, uint8_t length);	// read unsigned bits, 0 if beyond end
+bool ais_parse(const ais_payload &payload, ais_report &report);	// fill report, false if type unsupported or too short
+
+// read field, sign extended if necessary
+inline int32_t ais_get(const ais_payload &payload, const ais_field &field)
+{
+  uint32_t value = ais_get_bits(payload, field.start, field.length);
+  if (field.is_signed && (value & (1UL << (field.length - 1))))
+    value |= ~0UL << field.length;
+  return (int32_t)value;
+}
+
+// read character of text field as ASCII
+inline char ais_get_char(const ais_payload &payload, const ais_field &field, uint8_t index)
+{
+  uint8_t c = ais_get_bits(payload, field.start + index * 6, 6);
+  return c < 32 ? c + 64 : c;
+}
+
+// true if field lies completely within payload
+inline bool ais_has(const ais_payload &payload, const ais_field &field)
+{
+  return field.start + field.length <= payload.bits;
+}
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * Power saving. All reception is driven by interrupts, so loop() puts the
+ * AVR into idle sleep whenever no packet or command is waiting. Idle mode
+ * keeps the clocks running for the bit-clock interrupt, USB and timer 0,
+ * which also bound every sleep to about one millisecond. Peripherals that
+ * are never used are switched off.
+ *
+ * Time asleep is measured with timer 0 ticks, cheaper than micros() at the
+ * rate loop() wakes up. A sleep always ends before timer 0 overflows twice,
+ * so an 8 bit difference is enough. It includes the interrupts that ran
+ * while loop() slept.
+ *
+ * Statistics sentence, since the previous one:
+ *   $PAIS,PWR,<asleep in 0.1%>,<asleep ms>,<period ms>,<sleeps>
+ */
+
+#include "Arduino.h"
+#include <avr/sleep.h>
+#include <avr/power.h>
+#include "fifo.h"
+#include "nmea.h"
+#include "power.h"
+
+#define POWER_TICK_US (64000000L / F_CPU)   // timer 0 runs at F_CPU/64 in the Arduino core
+
+uint32_t power_asleep_ticks;        // timer 0 ticks spent in sleep
+uint32_t power_sleeps;              // number of times loop() slept
+uint32_t power_since;               // millis() at start of statistics period
+
+void power_setup(void)
+{
+  ADCSRA = 0;                       // disable ADC before stopping its clock
+  ACSR = _BV(ACD);                  // analog comparator off
+  power_adc_disable();
+  power_twi_disable();
+  power_usart1_disable();           // Serial is USB
+  power_timer1_disable();
+  power_timer3_disable();
+#ifdef PRTIM4
+  power_timer4_disable();
+#endif
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  power_since = millis();
+}
+
+void power_idle(void)
+{
+  noInterrupts();
+  if (fifo_packet_count() || Serial.available()) {
+    interrupts();                   // work arrived, stay awake
+    return;
+  }
+  uint8_t start = TCNT0;
+  sleep_enable();
+  interrupts();                     // sleep_cpu() still runs before a pending interrupt, no wake-up is lost
+  sleep_cpu();
+  sleep_disable();
+  power_asleep_ticks += (uint8_t)(TCNT0 - start);
+  power_sleeps++;
+}
+
+void power_stats(void)
+{
+  uint32_t now = millis();
+  uint32_t period = now - power_since;
+  uint32_t asleep = power_asleep_ticks / (1000 / POWER_TICK_US);
+  uint32_t share_asleep = asleep, share_period = period;
+  while (share_period > 4000000L) {   // keep share_asleep * 1000 within 32 bits
+    share_asleep >>= 1;
+    share_period >>= 1;
+  }
+  nmea_begin(F("PWR"));
+  nmea_push_number(share_period ? share_asleep * 1000 / share_period : 0);
+  nmea_push_number(asleep);
+  nmea_push_number(period);
+  nmea_push_number(power_sleeps);
+  nmea_end();
+  power_asleep_ticks = 0;
+  power_sleeps = 0;
+  power_since = now;
+}
@@ -0,0 +1,3 @@
+void power_setup(void);				// switch off unused peripherals, select idle sleep mode
+void power_idle(void);				// sleep until the next interrupt unless work is waiting, called from loop()
+void power_stats(void);				// send sleep statistics as $PAIS,PWR sentence, starts new period
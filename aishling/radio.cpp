@@ -2,6 +2,7 @@
 #include "radio.h"
 #include "SPI.h"
 #include <avr/pgmspace.h>
+#include "bench.h"
 
 const int si4463_sdn   = 9;  // Shutdown
 const int si4463_nsel  = 10;  // SPI
@@ -10,8 +11,11 @@ const int si4463_gpio0 = radio_clock;  // RX clock
 const int si4463_sck   = 15; // SPI
 const int si4463_miso  = 14; // SPI
 const int si4463_gpio1 = radio_data; // RX data, data guaranteed valid when clock rises.
+const int si4463_nirq  = radio_nirq; // interrupt request, used in packet handler mode
 
 #define T_POR (6) // ms
+#define CTS_TRIES 20000 // CTS polls before radio is considered dead, about 300ms, longer than IRCAL
+#define CTS_PROBE_TRIES 100 // CTS polls for health probes, about 1.5ms, a working radio answers within 100us
 #define T_SPI (1) // us Simplification of SPI timing scheme in data sheet table 8
 
 /////////////////////////////////////////////////////////////////////////////
@@ -67,6 +71,8 @@ const int si4463_gpio1 = radio_data; // RX data, data guaranteed valid when cloc
 #define GRP_FREQ_CONTROL  0x40
 #define GRP_RX_HOP        0x50
 
+#define FIFO_INFO_RX_RESET 0x02
+
 /////////////////////////////////////////////////////////////////////////////
 // SPI routines
 /////////////////////////////////////////////////////////////////////////////
@@ -89,14 +95,21 @@ uint8_t si4463_byte(uint8_t out) {
 }
 
 
+uint16_t si4463_cts_timeouts = 0;    // number of times the radio did not get ready
+
 // Radio ready flag
-bool si4463_wait_cts() {
+// Bounded by a loop count, micros() does not advance inside interrupts.
+bool si4463_wait_cts(uint16_t tries = CTS_TRIES) {
   uint8_t result;
   do {
     si4463_spi_start();
     si4463_byte(CMD_READ_CMD_BUFF);
     result = si4463_byte(0);
     si4463_spi_end();
+    if (!--tries) {
+      si4463_cts_timeouts++;
+      return false;
+    }
   } while (result != 0xff);
   return true;
 }
@@ -104,14 +117,15 @@ bool si4463_wait_cts() {
 // Command / response sequence
 int si4463_cmd(
   int wr_len, const uint8_t* wr_data,
-  int rd_len, uint8_t* rd_data
+  int rd_len, uint8_t* rd_data,
+  uint16_t tries = CTS_TRIES
 ) {
-  if (!si4463_wait_cts()) return 1;
+  if (!si4463_wait_cts(tries)) return 1;
   si4463_spi_start();
   for (;wr_len--;) si4463_byte(*wr_data++);
   si4463_spi_end();
   if (rd_len> 0) {
-    if (!si4463_wait_cts()) return 2;
+    if (!si4463_wait_cts(tries)) return 2;
     si4463_spi_start();
     si4463_byte(CMD_READ_CMD_BUFF);
     si4463_byte(0);
@@ -140,16 +154,116 @@ void si4463_set_prop(
 
 void radio_finetune() {
   static uint8_t cosc=0x52;
-  Serial.print("GLOBAL_XO_TUNE = 0x");
+  Serial.print(F("GLOBAL_XO_TUNE = 0x"));
   Serial.println(cosc,HEX);
 }
 
+uint8_t radio_packet_handler = 0;    // 1 if radio detects sync and fills its RX FIFO
+uint8_t radio_rx_channel = 0;        // channel of last radio_rx()
+
 void radio_rx(uint8_t channel)
 {
+  BENCH_ENTER(BENCH_RADIO_RX);
   uint8_t cmd[] = {CMD_START_RX, 0, 0, 0, 0, 0, 0, 0};
   cmd[1] = channel;
-  si4463_cmd(8, cmd, 0, NULL);
-  si4463_wait_cts();
+  radio_rx_channel = channel;
+  if (radio_packet_handler) {
+    uint8_t reset[] = {CMD_FIFO_INFO, FIFO_INFO_RX_RESET};  // drop rest of previous packet
+    si4463_cmd(2, reset, 0, NULL, CTS_PROBE_TRIES);
+    cmd[5] = 0x08;                                        // RXTIMEOUT_STATE RX
+    cmd[6] = 0x08;                                        // RXVALID_STATE RX, search next sync
+    cmd[7] = 0x08;                                        // RXINVALID_STATE RX
+  }
+  si4463_cmd(8, cmd, 0, NULL, CTS_PROBE_TRIES);           // called from interrupts, a tuned radio answers within 100us
+  si4463_wait_cts(CTS_PROBE_TRIES);
+  BENCH_EXIT();
+}
+
+uint8_t radio_get_chip_status()
+{
+  uint8_t cmd[] = {CMD_GET_CHIP_STATUS, 0};               // read and clear CHIP_PEND
+  uint8_t status[4] = {0xff, 0xff, 0xff, 0xff};
+  si4463_cmd(2, cmd, 4, status, CTS_PROBE_TRIES);
+  return status[0];                                       // CHIP_PEND
+}
+
+uint8_t radio_device_state()
+{
+  uint8_t cmd[] = {CMD_REQUEST_DEVICE_STATE};
+  uint8_t state[2] = {0xff, 0xff};
+  if (si4463_cmd(1, cmd, 2, state, CTS_PROBE_TRIES))
+    return 0xff;                                          // no answer
+  return state[0] & 0x0f;                                 // CURR_STATE MAIN_STATE
+}
+
+uint8_t radio_channel()
+{
+  if (!radio_packet_handler)
+    return radio_rx_channel;
+  uint8_t cmd[] = {CMD_REQUEST_DEVICE_STATE};             // radio hops by itself, see RX_HOP below
+  uint8_t state[2];
+  if (si4463_cmd(1, cmd, 2, state, CTS_PROBE_TRIES))
+    return radio_rx_channel;                              // no answer
+  return state[1];                                        // CURRENT_CHANNEL
+}
+
+uint8_t radio_rssi_raw()
+{
+  uint8_t cmd[] = {CMD_GET_MODEM_STATUS, 0xff};           // keep pending modem interrupts
+  uint8_t status[3];
+  if (si4463_cmd(2, cmd, 3, status, CTS_PROBE_TRIES))
+    return 0;                                             // no answer
+  return status[2];                                       // CURR_RSSI
+}
+
+uint16_t radio_cts_timeouts()
+{
+  return si4463_cts_timeouts;
+}
+
+// The bit clock (INT1) and NIRQ (INT6) interrupts talk to the radio as well.
+// Masking just these keeps timer 0 and USB running while the main program
+// waits for CTS.
+uint8_t radio_lock()
+{
+  uint8_t mask = EIMSK;
+  EIMSK = mask & ~(_BV(INT1) | _BV(INT6));
+  return mask;
+}
+
+void radio_unlock(uint8_t mask)
+{
+  EIMSK = mask;
+}
+
+uint8_t radio_modem_events()
+{
+  uint8_t cmd[] = {CMD_GET_MODEM_STATUS, 0};              // MODEM_CLR_PEND=0, read and clear all at once, NIRQ goes high
+  uint8_t pending = 0;
+  si4463_cmd(2, cmd, 1, &pending, CTS_PROBE_TRIES);       // called from NIRQ interrupt, keep CTS waits short
+  return pending;                                         // MODEM_PEND
+}
+
+void radio_int_status(uint8_t *status)
+{
+  uint8_t cmd[] = {CMD_GET_INT_STATUS, 0, 0, 0};          // read and clear all pending interrupts
+  si4463_cmd(4, cmd, 8, status);
+}
+
+uint8_t radio_read_fifo(uint8_t *buffer, uint8_t size)
+{
+  uint8_t cmd[] = {CMD_FIFO_INFO, 0};
+  uint8_t info[2];
+  si4463_cmd(2, cmd, 2, info);
+  uint8_t count = info[0] < size ? info[0] : size;      // RX_FIFO_COUNT
+  if (count) {
+    si4463_spi_start();                                   // FIFO access needs no CTS
+    si4463_byte(CMD_READ_RX_FIFO);
+    for (uint8_t i = 0; i < count; i++)
+      buffer[i] = si4463_byte(0);
+    si4463_spi_end();
+  }
+  return count;
 }
 
 int radio_rssi()
@@ -179,7 +293,7 @@ const uint8_t si4463_setup_data[] PROGMEM = {
     0x14, // GPIO1 - 14 RX_DATA
     0x61, // GPIO2 - RX_STATE mfr uses 0x61
     0x60, // GPIO3 - TX_STATE mfr uses 0x60
-    0x00, // NIRQ - DONOTHING
+    0x27, // NIRQ - NIRQ, radio events
     0x00, // SDO - 0 DONOTHING 0B SDO
     0x00, // GEN_CONFIG - DRV_STRENGTH max
 
@@ -296,8 +410,10 @@ const uint8_t si4463_setup_data[] PROGMEM = {
     0x00,// GLOBAL_CLK_CFG clock output disabled, 32kHz clock disabled ais_transponder: 01
   0x05, CMD_SET_PROPERTY, GRP_GLOBAL, 0x01, 0x03,
     0x60,// GLOBAL_CONFIG RESERVED=1 SEQUENCER_MODE=1 (no change) ais_transponder: 20
-  0x05, CMD_SET_PROPERTY, GRP_INT_CTL, 0x01, 0x00,
-    0x00,// INT_CTL_ENABLE
+  0x07, CMD_SET_PROPERTY, GRP_INT_CTL, 0x03, 0x00,
+    0x02,// INT_CTL_ENABLE MODEM_INT_STATUS_EN
+    0x00,// INT_CTL_PH_ENABLE
+    0x17,// INT_CTL_MODEM_ENABLE RSSI_JUMP INVALID_PREAMBLE PREAMBLE_DETECT SYNC_DETECT, see rxevent.cpp
   // ais_transponder: 07 18 01 08
   0x08, CMD_SET_PROPERTY, GRP_FRR_CTL, 0x04, 0x00,
     0x0A, // FRR_CTL_A_MODE LATCHED_RSSI
@@ -306,6 +422,16 @@ const uint8_t si4463_setup_data[] PROGMEM = {
     0x00, // FRR_CTL_D_MODE DISABLED
   0x05, CMD_SET_PROPERTY, GRP_PREAMBLE, 0x01, 0x01,
     0x14, // PREAMBLE_TX_LENGTH
+  // The training sequence 0101.. is NRZI coded on air, i.e. 0110 0110.. or its
+  // inverse, which the standard 1010 preamble detector does not match.
+  0x0B, CMD_SET_PROPERTY, GRP_PREAMBLE, 0x07, 0x02,
+    0x0F, // PREAMBLE_CONFIG_NSTD RX_ERRTOL=0 PATTERN_LENGTH=16 bits
+    0x03, // PREAMBLE_CONFIG_STD_2 RX_PREAMBLE_TIMEOUT 3 nibbles = 12 bits, earlier than PH_SYNC_TIMEOUT
+    0x80, // PREAMBLE_CONFIG RX_PREAM_SRC=non-standard pattern
+    0x66, 0x66, 0x66, 0x66, // PREAMBLE_PATTERN
+  0x08, CMD_SET_PROPERTY, GRP_SYNC, 0x03, 0x00,
+    0x00, // SYNC_CONFIG RX_ERRORS=0 LENGTH=1 byte
+    0x66, 0x66, // SYNC_BITS training sequence continues after preamble detection
     // ais_transponder: 0x08, 0x14, 0x00, 0x0F, 0x31, 0x00, 0x00, 0x00, 0x00
 // ais_transponder sets the following:
 // 1100: 01 CC CC 00 00 00
@@ -369,9 +495,13 @@ const uint8_t si4463_setup_data[] PROGMEM = {
     0x80, // MODEM_ANT_DIV_CONTROL ais_transponder: 00
     0x46, // MODEM_RSSI_THRESH ais_transponder: 0x46
     // ais_transponder continues 06 23
+  0x05, CMD_SET_PROPERTY, GRP_MODEM, 0x01, 0x4B,
+    0x0C, // MODEM_RSSI_JUMP_THRESH 6dB
   0x05, CMD_SET_PROPERTY, GRP_MODEM, 0x01, 0x4C,
     0x03, // ais_transponder: 09 (reset from line above!)
     // ais_transponder continues 1c
+  0x05, CMD_SET_PROPERTY, GRP_MODEM, 0x01, 0x4D,
+    0x18, // MODEM_RSSI_CONTROL2 RSSIJMP_UP ENRSSIJMP, rising signal only
   0x05, CMD_SET_PROPERTY, GRP_MODEM, 0x01, 0x4E,
     0x40, // MODEM_RSSI_COMP
   // ais_transponder sets the following:
@@ -413,74 +543,144 @@ const uint8_t si4463_setup_data[] PROGMEM = {
   0x00
 };
 
+// Switches the radio from raw data output to its packet handler: sync word
+// detection on the AIS training sequence, the following bits go into the RX
+// FIFO, NIRQ signals sync and FIFO fill level. Not verified on hardware yet.
+//
+// The training sequence 0101.. is NRZI coded on air, i.e. 0110 0110.. or its
+// inverse. 8 of these bits are the sync word, 0x66 matches both polarities
+// at some bit offset and reads the same in either bit order. A 16 bit sync
+// word would need too much of the 24 bit sequence while hopping. Start flag
+// detection and checking false syncs is left to the decoder.
+//
+// The radio also hops between the channels by itself: while no sync is found
+// and RSSI stays below MODEM_RSSI_THRESH for 16 bits, it moves on to the
+// other entry of the RX hop table. The AVR sleeps on an idle channel and asks
+// for the channel at sync. Hopping on preamble timeout is not used, preamble
+// detection and sync word together would leave too little of the training
+// sequence after a hop.
+const uint8_t si4463_packet_data[] PROGMEM = {
+  0x08, CMD_GPIO_PIN_CFG,
+    0x00, // GPIO0 - DONOTHING
+    0x00, // GPIO1 - DONOTHING
+    0x00, // GPIO2 - DONOTHING
+    0x00, // GPIO3 - DONOTHING
+    0x27, // NIRQ - NIRQ
+    0x00, // SDO - DONOTHING
+    0x00, // GEN_CONFIG
+  0x07, CMD_SET_PROPERTY, GRP_INT_CTL, 0x03, 0x00,
+    0x03, // INT_CTL_ENABLE PH_INT_STATUS_EN MODEM_INT_STATUS_EN
+    0x11, // INT_CTL_PH_ENABLE PACKET_RX_EN RX_FIFO_ALMOST_FULL_EN
+    0x01, // INT_CTL_MODEM_ENABLE SYNC_DETECT_EN
+  0x05, CMD_SET_PROPERTY, GRP_PREAMBLE, 0x01, 0x01,
+    0x00, // PREAMBLE_CONFIG_STD_1 RX_THRESH=0 no preamble detection, search sync word right away
+  0x05, CMD_SET_PROPERTY, GRP_PREAMBLE, 0x01, 0x04,
+    0x21, // PREAMBLE_CONFIG standard preamble, undo non-standard pattern of raw mode
+  0x08, CMD_SET_PROPERTY, GRP_SYNC, 0x03, 0x00,
+    0x00, // SYNC_CONFIG RX_ERRORS=0 LENGTH=1 byte
+    0x66, 0x66, // SYNC_BITS 8 bits of NRZI coded training sequence, second byte unused
+  0x05, CMD_SET_PROPERTY, GRP_PKT, 0x01, 0x06,
+    0x01, // PKT_CONFIG1 packet handler RX enabled, BIT_ORDER=LSB first
+  0x05, CMD_SET_PROPERTY, GRP_PKT, 0x01, 0x08,
+    0x00, // PKT_LEN fixed length from field 1
+  0x05, CMD_SET_PROPERTY, GRP_PKT, 0x01, 0x0C,
+    0x08, // PKT_RX_THRESHOLD interrupt at 8 bytes, short packets end soon after
+  0x08, CMD_SET_PROPERTY, GRP_PKT, 0x04, 0x0D,
+    0x00, 0x80, // PKT_FIELD_1_LENGTH 128 bytes, longer than any AIS packet
+    0x00, // PKT_FIELD_1_CONFIG no whitening, no manchester
+    0x00, // PKT_FIELD_1_CRC_CONFIG CRC is checked by decoder
+  0x08, CMD_SET_PROPERTY, GRP_RX_HOP, 0x04, 0x00,
+    0x24, // RX_HOP_CONTROL HOP_EN=RSSI timeout, RSSI_TIMEOUT=4 nibbles = 16 bits like PH_SYNC_TIMEOUT
+    0x02, // RX_HOP_TABLE_SIZE
+    0x00, 0x01, // RX_HOP_TABLE_ENTRY_0/1 channel A and B
+  0x00
+};
+
 void radio_test() {
   uint8_t result[32];
   uint8_t command[16];
   int i;
   command[0] = CMD_PART_INFO;
   si4463_cmd(1, command, 8, result);
-  Serial.print("PART_INFO: Si");
+  Serial.print(F("PART_INFO: Si"));
   Serial.print(result[1] >> 4,HEX);
   Serial.print(result[1] & 15,HEX);
   Serial.print(result[2] >> 4,HEX);
   Serial.print(result[2] & 15,HEX);
-  Serial.print(" REV ");
+  Serial.print(F(" REV "));
   Serial.print(result[0]);
-  Serial.print(" PART BUILD ");
+  Serial.print(F(" PART BUILD "));
   Serial.print(result[3]);
-  Serial.print(" ID ");
+  Serial.print(F(" ID "));
   Serial.print(result[4]*256+result[5]);
-  Serial.print(" CUSTOMER ");
+  Serial.print(F(" CUSTOMER "));
   Serial.print(result[6]);
-  Serial.print(" ROM_ID ");
+  Serial.print(F(" ROM_ID "));
   Serial.println(result[7]);
   uint32_t n;
   n = ((uint32_t)result[1] << 16) | (result[2]<<8) | result[7];
   switch(n) {
     //http://community.silabs.com/t5/Proprietary/Si446x-PART-INFO-and-FUNC-INFO-API-commands-question/td-p/153149
-    case 0x406003: Serial.println("Si4060-B1B"); break;
-    case 0x406303: Serial.println("Si4063-B1B"); break;
-    case 0x435503: Serial.println("Si4355-B1B"); break;
-    case 0x436203: Serial.println("Si4362-B1B"); break;
-    case 0x443803: Serial.println("Si4438-B1B"); break;
-    case 0x445503: Serial.println("Si4455-B1B"); break;
-    case 0x446003: Serial.println("Si4460-B1B"); break;
-    case 0x446103: Serial.println("Si4461-B1B"); break;
-    case 0x446303: Serial.println("Si4463-B1B"); break;
-    case 0x446403: Serial.println("Si4464-B1B"); break;
-    case 0x405506: Serial.println("Si4055-C2A"); break;
-    case 0x406006: Serial.println("Si4060-C2A"); break;
-    case 0x406306: Serial.println("Si4063-C2A"); break;
-    case 0x435506: Serial.println("Si4355-C2A"); break;
-    case 0x436206: Serial.println("Si4362-C2A"); break;
-    case 0x443806: Serial.println("Si4438-C2A"); break;
-    case 0x445506: Serial.println("Si4455-C2A"); break;
-    case 0x446006: Serial.println("Si4460-C2A"); break;
-    case 0x446106: Serial.println("Si4461-C2A"); break;
-    case 0x446306: Serial.println("Si4463-C2A"); break;
-    case 0x446406: Serial.println("Si4464-C2A"); break;
-    case 0x446706: Serial.println("Si4467-A2A"); break;
-    case 0x446806: Serial.println("Si4468-A2A"); break;
-    default: Serial.println("Device unknown!"); break;
+    case 0x406003: Serial.println(F("Si4060-B1B")); break;
+    case 0x406303: Serial.println(F("Si4063-B1B")); break;
+    case 0x435503: Serial.println(F("Si4355-B1B")); break;
+    case 0x436203: Serial.println(F("Si4362-B1B")); break;
+    case 0x443803: Serial.println(F("Si4438-B1B")); break;
+    case 0x445503: Serial.println(F("Si4455-B1B")); break;
+    case 0x446003: Serial.println(F("Si4460-B1B")); break;
+    case 0x446103: Serial.println(F("Si4461-B1B")); break;
+    case 0x446303: Serial.println(F("Si4463-B1B")); break;
+    case 0x446403: Serial.println(F("Si4464-B1B")); break;
+    case 0x405506: Serial.println(F("Si4055-C2A")); break;
+    case 0x406006: Serial.println(F("Si4060-C2A")); break;
+    case 0x406306: Serial.println(F("Si4063-C2A")); break;
+    case 0x435506: Serial.println(F("Si4355-C2A")); break;
+    case 0x436206: Serial.println(F("Si4362-C2A")); break;
+    case 0x443806: Serial.println(F("Si4438-C2A")); break;
+    case 0x445506: Serial.println(F("Si4455-C2A")); break;
+    case 0x446006: Serial.println(F("Si4460-C2A")); break;
+    case 0x446106: Serial.println(F("Si4461-C2A")); break;
+    case 0x446306: Serial.println(F("Si4463-C2A")); break;
+    case 0x446406: Serial.println(F("Si4464-C2A")); break;
+    case 0x446706: Serial.println(F("Si4467-A2A")); break;
+    case 0x446806: Serial.println(F("Si4468-A2A")); break;
+    default: Serial.println(F("Device unknown!")); break;
   }
   
   command[0] = CMD_FUNC_INFO;
   command[1] = 0;
   si4463_cmd(1, command, 6, result);
-  Serial.print("FUNC_INFO: EXT ");
+  Serial.print(F("FUNC_INFO: EXT "));
   Serial.print(result[0]);
-  Serial.print(" BRANCH ");
+  Serial.print(F(" BRANCH "));
   Serial.print(result[1]);
-  Serial.print(" INT ");
+  Serial.print(F(" INT "));
   Serial.print(result[2]);
-  Serial.print(" PATCH ");
+  Serial.print(F(" PATCH "));
   Serial.print(result[3]*256+result[4]);
-  Serial.print(" FUNC ");
+  Serial.print(F(" FUNC "));
   Serial.println(result[5]);
 }
 
-void radio_setup() {
+// Send list of commands from PROGMEM, each preceded by its length.
+// Stops at the first command the radio does not accept, returns its status.
+int si4463_upload(const uint8_t *data) {
   uint8_t si4463_cmd_buffer[16];
+  int i = 0;
+  while (pgm_read_byte_near(data+i)) {
+    int len;
+    len = pgm_read_byte_near(data + i);
+    i++;
+    memcpy_P(si4463_cmd_buffer, data + i, len);
+    int status = si4463_cmd(len, si4463_cmd_buffer, 0, NULL);
+    if (status)
+      return status;
+    i += len;
+  }
+  return 0;
+}
+
+bool radio_setup() {
   // Upload configuration to radio.
   // This is a 2GMSK demodulator channel hopping between AIS1 and AIS2.
   // Data on GPIO0, Clock on GPIO1.
@@ -501,15 +701,14 @@ void radio_setup() {
   delay(T_POR); // Wait tPOR = 5ms
 
   // Program SI4463
-  int i = 0;
-  while (pgm_read_byte_near(si4463_setup_data+i)) {
-    int len;
-    len = pgm_read_byte_near(si4463_setup_data + i);
-    i++;
-    memcpy_P(si4463_cmd_buffer, si4463_setup_data + i, len);
-    si4463_cmd(len, si4463_cmd_buffer, 0, NULL);
-    i += len;
-  }
+  radio_packet_handler = 0;
+  return si4463_upload(si4463_setup_data) == 0;
+}
+
+bool radio_packet_mode() {
+  pinMode(si4463_nirq, INPUT_PULLUP);
+  radio_packet_handler = 1;
+  return si4463_upload(si4463_packet_data) == 0;
 }
 
 void radio_test_clock(bool state) {
@@ -529,8 +728,8 @@ void radio_test_clock(bool state) {
     si4463_cmd(8, cmd, 0, NULL);
     si4463_set_prop(0, 1, 0x40); // 40 for 30MHz, 48 for 15MHz, 50 for 10MHz, 58 for 4MHz, 60 for 3MHz, 68 for 2MHz, 70 for 1MHz
   } else {
-    // Output system clock
-    cmd[5] = 2; // DRIVE_0
+    // Back to interrupt output
+    cmd[5] = 0x27; // NIRQ
     si4463_cmd(8, cmd, 0, NULL);
     si4463_set_prop(0, 1, 0x00); // 40 for 30MHz, 48 for 15MHz, 50 for 10MHz, 58 for 4MHz, 60 for 3MHz, 68 for 2MHz, 70 for 1MHz
   }
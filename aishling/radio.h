@@ -1,11 +1,24 @@
 const int radio_data = 3;
 const int radio_clock = 2;
+const int radio_nirq = 7;   // INT6, Si4463 NIRQ for radio events and packet handler mode
 
-void radio_setup();
+bool radio_setup();                                 // false if the radio stopped answering
 int radio_rssi();
+uint8_t radio_rssi_raw();                           // current RSSI in 0.5dB steps, dBm = value / 2 - 134, 0 if no answer within about 1.5ms
+uint8_t radio_channel();                            // channel the radio receives on, asks the radio in packet handler mode
 void radio_rx(uint8_t channel);
+bool radio_packet_mode();                           // use sync detection and RX FIFO, radio_setup() returns to raw mode
+uint8_t radio_modem_events();                       // read and clear all pending modem interrupts, 0 if no answer within about 1.5ms
+void radio_int_status(uint8_t *status);             // read and clear 8 interrupt status bytes
+uint8_t radio_read_fifo(uint8_t *buffer, uint8_t size);	// read up to size bytes from RX FIFO
 
-uint8_t radio_get_chip_status();
+#define RADIO_STATE_RX 8    // radio_device_state() while receiving
+
+uint8_t radio_get_chip_status();                    // read and clear CHIP_PEND, gives up after about 1.5ms
+uint8_t radio_device_state();                       // main state, 0xff if radio does not answer within about 1.5ms
+uint16_t radio_cts_timeouts();                      // number of commands the radio did not get ready for
+uint8_t radio_lock();                               // keep radio interrupts off the SPI bus, returns mask for radio_unlock()
+void radio_unlock(uint8_t mask);
 void radio_test();
 void radio_finetune();
 void radio_test_clock(bool);
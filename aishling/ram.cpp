@@ -0,0 +1,42 @@
+/*
+ * RAM use at runtime. ram_paint() fills the RAM between the end of static
+ * data and the stack with a pattern; the deepest stack use, including all
+ * interrupts, is where the pattern was overwritten. No heap is used, so the
+ * stack may grow down to the end of static data.
+ *
+ * Statistics sentence, in bytes:
+ *   $PAIS,MEM,<static>,<stack max>,<never used>,<free now>
+ * <never used> is the headroom left at the deepest stack use so far.
+ * host/rammap.sh shows how the static RAM is split between modules.
+ */
+
+#include "Arduino.h"
+#include "nmea.h"
+#include "ram.h"
+
+#define RAM_PATTERN     0xc5    // unlikely to be written by the stack
+#define RAM_PAINT_GAP   16      // bytes below own stack frame left unpainted
+
+extern uint8_t __heap_start;    // end of static data, provided by the linker
+
+void ram_paint(void)
+{
+  uint8_t *p = &__heap_start;
+  uint8_t *end = (uint8_t *)(uintptr_t)SP - RAM_PAINT_GAP;
+  while (p < end)
+    *p++ = RAM_PATTERN;
+}
+
+void ram_stats(void)
+{
+  uint8_t *p = &__heap_start;
+  uint8_t *sp = (uint8_t *)(uintptr_t)SP;
+  while (p < sp && *p == RAM_PATTERN)
+    p++;
+  nmea_begin(F("MEM"));
+  nmea_push_number((uintptr_t)&__heap_start - RAMSTART);
+  nmea_push_number(RAMEND + 1 - (uintptr_t)p);
+  nmea_push_number(p - &__heap_start);
+  nmea_push_number(sp - &__heap_start);
+  nmea_end();
+}
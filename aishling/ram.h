@@ -0,0 +1,2 @@
+void ram_paint(void);				// fill free RAM below the stack with a pattern, call first in setup()
+void ram_stats(void);				// send RAM use and stack high-water mark as $PAIS,MEM sentence
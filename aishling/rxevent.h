@@ -0,0 +1,4 @@
+void rxevent_start(void);			// route radio events on NIRQ to rxevent_interrupt()
+void rxevent_interrupt(void);		// NIRQ interrupt in raw bit mode
+void rxevent_sync(void);			// decoder found start flag, called from bit-clock interrupt
+void rxevent_stats(void);			// send event counters as $PAIS,EVT sentence
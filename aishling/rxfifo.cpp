@@ -0,0 +1,77 @@
+/*
+ * Packet handler receive mode. The Si4463 searches for the training sequence
+ * itself and stores the following bits in its RX FIFO. NIRQ wakes the AVR on
+ * sync and whenever a few bytes are waiting, they are read in a burst and
+ * decoded by ais_process_byte(). On an idle channel the radio hops between
+ * the channels by itself (RX hop table, see radio.cpp), the AVR only changes
+ * the channel after a packet or a false sync and otherwise sleeps.
+ */
+
+#include "Arduino.h"
+#include "radio.h"
+#include "ais.h"
+#include "rxfifo.h"
+
+#define RXFIFO_BURST      16      // bytes read from radio at once
+
+// GET_INT_STATUS response
+#define INT_PH_PEND             2
+#define INT_MODEM_PEND          4
+#define PH_PACKET_RX            0x10
+#define PH_RX_FIFO_ALMOST_FULL  0x01
+#define MODEM_SYNC_DETECT       0x01
+
+volatile uint8_t rxfifo_active = 0;                 // 1 in packet handler mode
+
+static void rxfifo_drain(void)
+{
+  // feed FIFO content into decoder until the packet ends
+  uint8_t buffer[RXFIFO_BURST];
+  uint8_t count;
+  while ((count = radio_read_fifo(buffer, sizeof(buffer))) > 0) {
+    for (uint8_t i = 0; i < count; i++) {
+      if (!ais_receiving())                         // packet complete, decoder changed channel
+        return;                                     // and radio dropped the rest of the FIFO
+      ais_process_byte(buffer[i]);
+    }
+  }
+}
+
+void rxfifo_interrupt(void)
+{
+  uint8_t status[8];
+  do {
+    radio_int_status(status);
+    if (status[INT_MODEM_PEND] & MODEM_SYNC_DETECT)
+      ais_sync(radio_channel());
+    if (status[INT_PH_PEND] & (PH_RX_FIFO_ALMOST_FULL | PH_PACKET_RX)) {
+      rxfifo_drain();
+      if ((status[INT_PH_PEND] & PH_PACKET_RX) && ais_receiving())
+        ais_hop();                                  // field length reached without end flag
+    }
+  } while (!digitalRead(radio_nirq));               // NIRQ stays low while anything is pending
+}
+
+void rxfifo_start(void)
+{
+  ais_off();
+  radio_packet_mode();
+  rxfifo_active = 1;
+  attachInterrupt(digitalPinToInterrupt(radio_nirq), rxfifo_interrupt, FALLING);
+  ais_hop();
+}
+
+void rxfifo_stop(void)
+{
+  detachInterrupt(digitalPinToInterrupt(radio_nirq));
+  rxfifo_active = 0;
+  ais_off();
+  radio_setup();
+  ais_on();                                         // decoder restarts and hops on next bit
+  radio_rx(0);
+}
+
+uint8_t rxfifo_enabled(void)
+{
+  return rxfifo_active;
+}
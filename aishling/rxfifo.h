@@ -0,0 +1,4 @@
+void rxfifo_start(void);			// switch radio to packet handler mode, bit clock interrupt must be detached
+void rxfifo_stop(void);				// back to raw bit output, reconfigures radio
+void rxfifo_interrupt(void);		// NIRQ interrupt, reads RX FIFO into decoder
+uint8_t rxfifo_enabled(void);		// 1 in packet handler mode
@@ -0,0 +1,141 @@
+/*
+ * RSSI survey. While the decoder keeps running, the current RSSI is sampled
+ * at a fixed rate and booked to the channel the radio is tuned to, so both
+ * AIS channels are covered as the receiver hops. Samples that would fall into
+ * a packet being received are skipped. Every SURVEY_INTERVAL each
+ * channel is reported and its statistics are cleared:
+ *   $PAIS,SVY,<channel>,<samples>,<occupancy>,<mean>,<peak>
+ *   $PAIS,SVH,<channel>,0,<bin 0>,...,<bin 7>
+ *   $PAIS,SVH,<channel>,8,<bin 8>,...,<bin 15>
+ * occupancy and bins in 0.1% of samples, mean and peak in dBm. Bins are
+ * 4dB wide, bin 0 holds everything up to -126dBm and bin 15 everything
+ * from -70dBm. A sample is occupied at or above SURVEY_BUSY, which matches
+ * MODEM_RSSI_THRESH in radio.cpp.
+ */
+
+#include "Arduino.h"
+#include "radio.h"
+#include "ais.h"
+#include "nmea.h"
+#include "survey.h"
+
+#define SURVEY_SAMPLE_US    10000   // us between samples
+#define SURVEY_INTERVAL     10000   // ms between reports
+#define SURVEY_BINS         16      // histogram bins per channel
+#define SURVEY_BINS_LINE    8       // bins per $PAIS,SVH sentence, keeps it below 82 characters
+#define SURVEY_BIN_BASE     8       // raw RSSI at bottom of bin 1, -130dBm
+#define SURVEY_BIN_SHIFT    3       // 8 raw steps = 4dB per bin
+#define SURVEY_BUSY         0x46    // raw RSSI counted as occupied, -99dBm
+
+#define SURVEY_DBM(raw)     ((int16_t)((raw) >> 1) - 134)
+
+struct survey_channel {
+  uint16_t samples;
+  uint16_t busy;                    // samples at or above SURVEY_BUSY
+  uint32_t sum;                     // sum of raw RSSI
+  uint8_t peak;                     // highest raw RSSI
+  uint16_t bins[SURVEY_BINS];
+};
+
+survey_channel survey_channels[2];
+uint8_t survey_active;              // 1 while survey is running
+uint32_t survey_last_sample;        // micros() of last sample
+uint32_t survey_last_report;        // millis() of last report
+
+static void survey_clear(void)
+{
+  memset(survey_channels, 0, sizeof(survey_channels));
+}
+
+static void survey_sample(void)
+{
+  // SPI is shared with the radio interrupts, keep them out for the sample;
+  // the bit clock is masked meanwhile, so never sample within a packet
+  if (ais_in_packet())
+    return;
+  uint8_t mask = radio_lock();
+  uint8_t channel = radio_channel();
+  uint8_t rssi = radio_rssi_raw();
+  radio_unlock(mask);
+  if (!rssi || channel > 1)         // radio did not answer
+    return;
+
+  survey_channel &c = survey_channels[channel];
+  if (c.samples == 0xffff)
+    return;
+  c.samples++;
+  c.sum += rssi;
+  if (rssi > c.peak)
+    c.peak = rssi;
+  if (rssi >= SURVEY_BUSY)
+    c.busy++;
+  uint8_t bin = rssi < SURVEY_BIN_BASE ? 0 : (rssi - SURVEY_BIN_BASE) >> SURVEY_BIN_SHIFT;
+  if (bin >= SURVEY_BINS)
+    bin = SURVEY_BINS - 1;
+  c.bins[bin]++;
+}
+
+// share of samples in 0.1%
+static uint16_t survey_permille(uint16_t count, uint16_t samples)
+{
+  return (uint32_t)count * 1000 / samples;
+}
+
+static void survey_report(void)
+{
+  for (uint8_t channel = 0; channel < 2; channel++) {
+    survey_channel &c = survey_channels[channel];
+    if (!c.samples)
+      continue;
+    nmea_begin(F("SVY"));
+    nmea_push_string(channel ? F(",B") : F(",A"));
+    nmea_push_number(c.samples);
+    nmea_push_number(survey_permille(c.busy, c.samples));
+    nmea_push_number(SURVEY_DBM(c.sum / c.samples));
+    nmea_push_number(SURVEY_DBM(c.peak));
+    nmea_end();
+    for (uint8_t first = 0; first < SURVEY_BINS; first += SURVEY_BINS_LINE) {
+      nmea_begin(F("SVH"));
+      nmea_push_string(channel ? F(",B") : F(",A"));
+      nmea_push_number(first);
+      for (uint8_t i = first; i < first + SURVEY_BINS_LINE; i++)
+        nmea_push_number(survey_permille(c.bins[i], c.samples));
+      nmea_end();
+    }
+  }
+  survey_clear();
+}
+
+void survey_start(void)
+{
+  survey_clear();
+  survey_last_sample = micros();
+  survey_last_report = millis();
+  survey_active = 1;
+}
+
+void survey_stop(void)
+{
+  survey_active = 0;
+}
+
+uint8_t survey_enabled(void)
+{
+  return survey_active;
+}
+
+void survey_poll(void)
+{
+  if (!survey_active)
+    return;
+  if (micros() - survey_last_sample >= SURVEY_SAMPLE_US) {
+    survey_last_sample += SURVEY_SAMPLE_US;
+    if (micros() - survey_last_sample >= SURVEY_SAMPLE_US)
+      survey_last_sample = micros();  // fell behind, e.g. long UART output, skip missed samples
+    survey_sample();
+  }
+  if (millis() - survey_last_report >= SURVEY_INTERVAL) {
+    survey_last_report += SURVEY_INTERVAL;
+    survey_report();
+  }
+}
@@ -0,0 +1,4 @@
+void survey_start(void);			// clear statistics and start sampling RSSI
+void survey_stop(void);
+uint8_t survey_enabled(void);		// 1 while survey is running
+void survey_poll(void);				// take RSSI sample when due, send report every SURVEY_INTERVAL, called from loop()
@@ -0,0 +1,202 @@
+/*
+ * Vessel target table. Keeps the last known state of received vessels in a
+ * fixed size open addressing hash table keyed by MMSI. Targets not heard for
+ * TARGET_MAX_AGE seconds are removed, if the table is full the oldest target
+ * is replaced.
+ *
+ * In summary mode, each target updated since the last summary is sent once
+ * per TARGET_SUMMARY_INTERVAL, or when it is replaced before the summary is
+ * due because more than TARGET_SLOTS - 1 vessels are in range, as
+ *   $PAIS,TGT,<mmsi>,<lat>,<lon>,<sog>,<cog>,<age>,<count>*hh
+ * lat/lon in 1/10000 minutes, sog in 0.1 knots, cog in 0.1 degrees, age in seconds.
+ */
+
+#include "Arduino.h"
+#include "payload.h"
+#include "nmea.h"
+#include "targets.h"
+
+#define TARGET_SLOTS            16    // size of target table (must be 2^x)
+#define TARGET_SLOT_MASK        (TARGET_SLOTS - 1)
+#define TARGET_MAX_AGE          600   // seconds until a silent target is removed
+#define TARGET_SUMMARY_INTERVAL 30    // seconds between summaries in summary mode
+
+#define TARGET_UPDATED          0x01  // target received since last summary
+
+struct target {
+  uint32_t mmsi;                      // 0 = free slot
+  int32_t lat;
+  int32_t lon;
+  uint16_t sog;
+  uint16_t cog;
+  uint16_t last_seen;                 // seconds, wraps after 18 hours
+  uint16_t count;                     // number of received messages
+  uint8_t flags;
+};
+
+target targets[TARGET_SLOTS];
+uint8_t targets_used;                 // number of occupied slots
+bool targets_summary_mode = false;
+uint16_t targets_last_summary;        // time of last summary
+uint16_t targets_last_expiry;         // time of last expiry check
+
+// time in seconds for age calculations
+static uint16_t targets_now(void)
+{
+  return millis() / 1000;
+}
+
+// home slot of MMSI
+static uint8_t targets_hash(uint32_t mmsi)
+{
+  return (uint8_t)((mmsi * 2654435761UL) >> 24) & TARGET_SLOT_MASK;
+}
+
+// remove target in slot, moves following targets back so lookups stay valid
+static void targets_remove(uint8_t slot)
+{
+  uint8_t next = slot;
+  for (;;) {
+    targets[slot].mmsi = 0;
+    for (;;) {
+      next = (next + 1) & TARGET_SLOT_MASK;
+      if (targets[next].mmsi == 0) {  // end of probe sequence
+        targets_used--;
+        return;
+      }
+      // move target if its home slot is not between the hole and its position
+      uint8_t home = targets_hash(targets[next].mmsi);
+      if (((next - home) & TARGET_SLOT_MASK) >= ((next - slot) & TARGET_SLOT_MASK))
+        break;
+    }
+    targets[slot] = targets[next];
+    slot = next;
+  }
+}
+
+// send one target
+static void targets_send(const target &t, uint16_t now)
+{
+  nmea_begin(F("TGT"));
+  nmea_push_number(t.mmsi);
+  nmea_push_number(t.lat);
+  nmea_push_number(t.lon);
+  nmea_push_number(t.sog);
+  nmea_push_number(t.cog);
+  nmea_push_number((uint16_t)(now - t.last_seen));
+  nmea_push_number(t.count);
+  nmea_end();
+}
+
+// remove the target heard longest ago, in summary mode report it first
+static void targets_remove_oldest(uint16_t now)
+{
+  uint8_t oldest = 0;
+  uint16_t oldest_age = 0;
+  for (uint8_t i = 0; i < TARGET_SLOTS; i++) {
+    uint16_t age = now - targets[i].last_seen;
+    if (targets[i].mmsi && age >= oldest_age) {
+      oldest = i;
+      oldest_age = age;
+    }
+  }
+  if (targets_summary_mode && (targets[oldest].flags & TARGET_UPDATED))
+    targets_send(targets[oldest], now);   // not in a summary yet, would be lost
+  targets_remove(oldest);
+}
+
+void targets_reset(void)
+{
+  for (uint8_t i = 0; i < TARGET_SLOTS; i++)
+    targets[i].mmsi = 0;
+  targets_used = 0;
+  targets_last_summary = targets_now();
+  targets_last_expiry = targets_last_summary;
+}
+
+void targets_update(const ais_report &report)
+{
+  if (report.mmsi == 0)
+    return;
+
+  uint16_t now = targets_now();
+  uint8_t slot = targets_hash(report.mmsi);
+  while (targets[slot].mmsi && targets[slot].mmsi != report.mmsi)
+    slot = (slot + 1) & TARGET_SLOT_MASK;
+
+  target *t = &targets[slot];
+  if (t->mmsi == 0) {                 // new target
+    if (targets_used == TARGET_SLOTS - 1) {
+      targets_remove_oldest(now);     // keep one slot free to terminate probing
+      slot = targets_hash(report.mmsi);
+      while (targets[slot].mmsi)
+        slot = (slot + 1) & TARGET_SLOT_MASK;
+      t = &targets[slot];
+    }
+    t->mmsi = report.mmsi;
+    t->lat = AIS_LAT_NA;
+    t->lon = AIS_LON_NA;
+    t->sog = AIS_SOG_NA;
+    t->cog = AIS_COG_NA;
+    t->count = 0;
+    t->flags = 0;
+    targets_used++;
+  }
+
+  if (report.flags & AIS_HAS_POSITION) {
+    t->lat = report.lat;
+    t->lon = report.lon;
+  }
+  if (report.flags & AIS_HAS_MOTION) {
+    t->sog = report.sog;
+    t->cog = report.cog;
+  }
+  t->last_seen = now;
+  if (t->count != 0xffff)
+    t->count++;
+  t->flags |= TARGET_UPDATED;
+}
+
+void targets_poll(void)
+{
+  uint16_t now = targets_now();
+
+  if (now != targets_last_expiry) {   // once per second
+    targets_last_expiry = now;
+    uint8_t i = 0;
+    while (i < TARGET_SLOTS) {
+      if (targets[i].mmsi && (uint16_t)(now - targets[i].last_seen) > TARGET_MAX_AGE)
+        targets_remove(i);            // slot may now hold a moved target, check again
+      else
+        i++;
+    }
+  }
+
+  if (targets_summary_mode && (uint16_t)(now - targets_last_summary) >= TARGET_SUMMARY_INTERVAL) {
+    targets_last_summary = now;
+    for (uint8_t i = 0; i < TARGET_SLOTS; i++)
+      if (targets[i].mmsi && (targets[i].flags & TARGET_UPDATED)) {
+        targets_send(targets[i], now);
+        targets[i].flags &= ~TARGET_UPDATED;
+      }
+  }
+}
+
+void targets_dump(void)
+{
+  uint16_t now = targets_now();
+  for (uint8_t i = 0; i < TARGET_SLOTS; i++)
+    if (targets[i].mmsi)
+      targets_send(targets[i], now);
+}
+
+void targets_summary(bool enable)
+{
+  targets_summary_mode = enable;
+  targets_last_summary = targets_now();
+}
+
+bool targets_summary_enabled(void)
+{
+  return targets_summary_mode;
+}
@@ -0,0 +1,8 @@
+struct ais_report;
+
+void targets_reset(void);						// clear target table
+void targets_update(const ais_report &report);	// add or refresh target from decoded message
+void targets_poll(void);						// expire old targets, send summary when due, called from loop()
+void targets_dump(void);						// send all targets as $PAIS,TGT sentences
+void targets_summary(bool enable);				// enable summary only output mode
+bool targets_summary_enabled(void);				// true if summary only output mode is active
@@ -0,0 +1,195 @@
+#include "ais_archive.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "../aishling/payload.h"
+
+archive_writer::~archive_writer()
+{
+  close();
+}
+
+bool archive_writer::open(const char *name)
+{
+  close();
+  fd = ::open(name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return false;
+
+  archive_file_header file;
+  if (st.st_size == 0) {
+    memset(&file, 0, sizeof(file));
+    memcpy(file.magic, ARCHIVE_FILE_MAGIC, sizeof(file.magic));
+    file.version = 1;
+    file.bloom_bits = ARCHIVE_BLOOM_BITS;
+    if (write(fd, &file, sizeof(file)) != sizeof(file))
+      return false;
+  } else {
+    if (pread(fd, &file, sizeof(file), 0) != sizeof(file) ||
+        memcmp(file.magic, ARCHIVE_FILE_MAGIC, sizeof(file.magic)) || file.bloom_bits != ARCHIVE_BLOOM_BITS)
+      return false;
+    // find end of last complete block, cut off what follows
+    off_t offset = sizeof(file);
+    archive_block_header h;
+    while (pread(fd, &h, sizeof(h), offset) == sizeof(h) && h.magic == ARCHIVE_BLOCK_MAGIC &&
+           h.size >= sizeof(h) && offset + (off_t)h.size <= st.st_size)
+      offset += h.size;
+    if (offset != st.st_size && ftruncate(fd, offset) < 0)
+      return false;
+  }
+  end = lseek(fd, 0, SEEK_END);
+  if (end < 0)
+    return false;
+  count = 0;
+  return true;
+}
+
+void archive_writer::add(int64_t time, uint8_t channel, int8_t rssi, const uint8_t *payload, size_t size)
+{
+  if (size == 0 || size > 255)
+    return;
+  if (count && std::max(time, header.time_max) - std::min(time, header.time_min) > UINT32_MAX)
+    flush();                                        // time_offset would wrap, e.g. after a gap in old logs
+  if (count == 0) {
+    memset(&header, 0, sizeof(header));
+    header.time_min = time;
+    header.time_max = time;
+    block.assign(sizeof(header), 0);
+    times.clear();
+  }
+  ais_payload view = {payload, 0, 0xffff, (uint16_t)(size * 8)};
+  archive_record_header r;
+  r.time_offset = 0;                                // set in flush(), time_min may still change
+  r.mmsi = ais_get(view, AIS_MMSI);
+  r.type = ais_get(view, AIS_TYPE);
+  r.channel = channel;
+  r.rssi = rssi;
+  r.size = size;
+  const uint8_t *p = (const uint8_t *)&r;
+  block.insert(block.end(), p, p + sizeof(r));
+  block.insert(block.end(), payload, payload + size);
+  times.push_back(time);
+
+  if (time < header.time_min)
+    header.time_min = time;
+  if (time > header.time_max)
+    header.time_max = time;
+  header.type_mask |= archive_type_bit(r.type);
+  uint16_t bits[3];
+  archive_bloom_bits(r.mmsi, bits);
+  for (uint16_t b : bits)
+    header.bloom[b / 64] |= 1ULL << (b % 64);
+
+  if (++count >= block_records)
+    flush();
+}
+
+bool archive_writer::flush()
+{
+  if (count == 0)
+    return true;
+  if (fd < 0) {
+    records_lost += count;
+    count = 0;
+    return false;
+  }
+  uint8_t *p = block.data() + sizeof(header);
+  for (size_t i = 0; i < count; i++) {              // times relative to block start
+    uint32_t offset = times[i] - header.time_min;
+    memcpy(p, &offset, sizeof(offset));
+    p += sizeof(archive_record_header) + p[offsetof(archive_record_header, size)];
+  }
+  block.resize((block.size() + 7) & ~(size_t)7);    // keep next header aligned
+  header.magic = ARCHIVE_BLOCK_MAGIC;
+  header.size = block.size();
+  header.count = count;
+  memcpy(block.data(), &header, sizeof(header));
+  if (write(fd, block.data(), block.size()) != (ssize_t)block.size()) {
+    // cut off the partial block so the next one follows a complete block
+    if (ftruncate(fd, end) < 0 || lseek(fd, end, SEEK_SET) < 0) {
+      ::close(fd);                                  // cannot repair, stop writing
+      fd = -1;
+    }
+    records_lost += count;
+    count = 0;
+    return false;
+  }
+  end += block.size();
+  blocks++;
+  records += count;
+  count = 0;
+  return true;
+}
+
+void archive_writer::close()
+{
+  if (fd < 0)
+    return;
+  flush();
+  ::close(fd);
+  fd = -1;
+}
+
+archive_reader::~archive_reader()
+{
+  close();
+}
+
+bool archive_reader::open(const char *name)
+{
+  close();
+  int fd = ::open(name, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(archive_file_header)) {
+    ::close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+  data = (const uint8_t *)map;
+  size = st.st_size;
+
+  const archive_file_header *file = (const archive_file_header *)data;
+  if (memcmp(file->magic, ARCHIVE_FILE_MAGIC, sizeof(file->magic)) || file->bloom_bits != ARCHIVE_BLOOM_BITS) {
+    close();
+    return false;
+  }
+  for (size_t offset = sizeof(archive_file_header); const archive_block_header *h = block_at(offset);
+       offset += h->size) {
+    blocks++;
+    records += h->count;
+  }
+  return true;
+}
+
+void archive_reader::close()
+{
+  if (data)
+    munmap((void *)data, size);
+  data = nullptr;
+  size = 0;
+  blocks = records = blocks_read = 0;
+}
+
+// complete block at offset, nullptr at end of file or torn block
+const archive_block_header *archive_reader::block_at(size_t offset) const
+{
+  if (offset + sizeof(archive_block_header) > size)
+    return nullptr;
+  const archive_block_header *h = (const archive_block_header *)(data + offset);
+  if (h->magic != ARCHIVE_BLOCK_MAGIC || h->size < sizeof(*h) || offset + h->size > size)
+    return nullptr;
+  return h;
+}
@@ -0,0 +1,175 @@
+/*
+ * Append-only archive of received AIS messages. After a 16 byte file header
+ * the file is a sequence of self-contained blocks. Each block header holds
+ * the time range, a mask of the message types and a Bloom filter of the
+ * MMSIs of its records, so a query only reads the records of blocks that
+ * can match. Readers map the file into memory.
+ *
+ * A block is written with a single write() once it is full or the writer
+ * flushes. A torn block at the end, e.g. after a power failure, is ignored by
+ * readers and cut off when a writer opens the file again; a write that fails
+ * is cut off right away and its records are lost. Readers check every record
+ * against the size of its block, a damaged block ends the scan of that block.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <sys/types.h>
+
+#define ARCHIVE_FILE_MAGIC      "AISARC1"   // 8 bytes with terminating 0
+#define ARCHIVE_BLOCK_MAGIC     0x4b4c4241  // "ABLK"
+#define ARCHIVE_BLOCK_RECORDS   4096        // default records per block
+#define ARCHIVE_BLOOM_BITS      2048        // about 5% false positives at 300 vessels per block
+#define ARCHIVE_RSSI_NA         -128        // RSSI not reported by receiver
+
+struct archive_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t bloom_bits;
+};
+
+struct archive_block_header {
+  uint32_t magic;
+  uint32_t size;                  // bytes including header, multiple of 8
+  uint32_t count;                 // number of records
+  uint32_t type_mask;             // bit n: block holds message type n, types from 31 share bit 31
+  int64_t time_min;               // ms since epoch
+  int64_t time_max;
+  uint64_t bloom[ARCHIVE_BLOOM_BITS / 64];   // MMSIs of the records
+};
+
+// stored record, followed by size payload bytes, not aligned
+struct archive_record_header {
+  uint32_t time_offset;           // ms after block time_min, blocks span at most 49 days
+  uint32_t mmsi;
+  uint8_t type;
+  uint8_t channel;                // 0 = A, 1 = B
+  int8_t rssi;                    // dBm, ARCHIVE_RSSI_NA if unknown
+  uint8_t size;                   // payload bytes
+};
+
+// record as seen by queries, payload points into the mapped file
+struct archive_record {
+  int64_t time;                   // ms since epoch
+  uint32_t mmsi;
+  uint8_t type;
+  uint8_t channel;
+  int8_t rssi;
+  uint8_t size;
+  const uint8_t *payload;         // AIS payload bytes, first bit in MSB, without CRC
+};
+
+struct archive_query {
+  uint32_t mmsi = 0;              // 0 = any
+  uint32_t type_mask = 0xffffffff;
+  int64_t from = INT64_MIN;       // ms since epoch, inclusive
+  int64_t to = INT64_MAX;
+};
+
+class archive_writer {
+public:
+  ~archive_writer();
+
+  bool open(const char *name);    // creates file or appends to it
+  void add(int64_t time, uint8_t channel, int8_t rssi, const uint8_t *payload, size_t size);
+  bool flush();                   // writes pending records as a block, false if they were lost
+  void close();
+
+  size_t pending() const { return count; }
+
+  size_t block_records = ARCHIVE_BLOCK_RECORDS;
+  uint64_t blocks = 0;            // blocks written
+  uint64_t records = 0;           // records written
+  uint64_t records_lost = 0;      // records of blocks that could not be written
+
+private:
+  int fd = -1;
+  off_t end = 0;                  // end of last complete block
+  size_t count = 0;
+  archive_block_header header;
+  std::vector<uint8_t> block;     // header and records of the block being filled
+  std::vector<int64_t> times;     // time of each pending record
+};
+
+class archive_reader {
+public:
+  ~archive_reader();
+
+  bool open(const char *name);    // maps file, false if missing or not an archive
+  void close();
+
+  // Calls on_record(const archive_record &) for every record matching q,
+  // in file order.
+  template <class F> void scan(const archive_query &q, F &&on_record);
+
+  uint64_t blocks = 0;            // complete blocks in file
+  uint64_t records = 0;           // records in complete blocks
+  uint64_t blocks_read = 0;       // blocks whose records were read by scan()
+
+private:
+  const archive_block_header *block_at(size_t offset) const;
+
+  const uint8_t *data = nullptr;
+  size_t size = 0;
+};
+
+// Bloom filter positions of an MMSI
+inline void archive_bloom_bits(uint32_t mmsi, uint16_t bits[3])
+{
+  uint64_t h = mmsi * 0x9e3779b97f4a7c15ULL;
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+  bits[0] = h % ARCHIVE_BLOOM_BITS;
+  bits[1] = (h >> 16) % ARCHIVE_BLOOM_BITS;
+  bits[2] = (h >> 32) % ARCHIVE_BLOOM_BITS;
+}
+
+inline bool archive_bloom_test(const uint64_t *bloom, uint32_t mmsi)
+{
+  uint16_t bits[3];
+  archive_bloom_bits(mmsi, bits);
+  for (uint16_t b : bits)
+    if (!(bloom[b / 64] >> (b % 64) & 1))
+      return false;
+  return true;
+}
+
+inline uint32_t archive_type_bit(uint8_t type)
+{
+  return 1u << (type < 31 ? type : 31);
+}
+
+template <class F>
+void archive_reader::scan(const archive_query &q, F &&on_record)
+{
+  uint32_t type_mask = q.type_mask;
+  for (size_t offset = sizeof(archive_file_header); const archive_block_header *h = block_at(offset);
+       offset += h->size) {
+    if (h->time_max < q.from || h->time_min > q.to || !(h->type_mask & type_mask) ||
+        (q.mmsi && !archive_bloom_test(h->bloom, q.mmsi)))
+      continue;
+    blocks_read++;
+    const uint8_t *p = (const uint8_t *)(h + 1);
+    const uint8_t *block_end = (const uint8_t *)h + h->size;
+    for (uint32_t i = 0; i < h->count; i++) {
+      archive_record_header r;
+      if ((size_t)(block_end - p) < sizeof(r))
+        break;                                      // damaged block, count does not fit its size
+      memcpy(&r, p, sizeof(r));
+      const uint8_t *payload = p + sizeof(r);
+      if ((size_t)(block_end - payload) < r.size)
+        break;
+      p = payload + r.size;
+      int64_t time = h->time_min + r.time_offset;
+      if ((q.mmsi && r.mmsi != q.mmsi) || !(archive_type_bit(r.type) & type_mask) ||
+          time < q.from || time > q.to)
+        continue;
+      on_record(archive_record{time, r.mmsi, r.type, r.channel, r.rssi, r.size, payload});
+    }
+  }
+}
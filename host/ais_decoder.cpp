@@ -0,0 +1,61 @@
+#include "ais_decoder.h"
+
+ais_decoder::ais_decoder(uint8_t channel) : channel(channel)
+{
+  packet.reserve(AIS_MAX_PACKET_BITS / 8 + 2);
+}
+
+void ais_decoder::reset()
+{
+  state = STATE_RESET;
+}
+
+// preamble and start flag detection, returns true after last bit of start flag
+bool ais_decoder::wait_for_sync(uint8_t bit)
+{
+  switch (sync_state) {
+    case SYNC_RESET:
+      if (bit_count > AIS_SYNC_TIMEOUT)
+        state = STATE_RESET;                  // firmware hops channel here
+      else {
+        sync_count = 0;
+        sync_state = bit ? SYNC_1 : SYNC_0;
+      }
+      break;
+
+    case SYNC_0:                              // last bit was a 0
+      if (bit) {
+        sync_count++;
+        sync_state = SYNC_1;
+      } else if (sync_count > AIS_PREAMBLE_LENGTH) {
+        sync_count = 7;                       // already have 1 of 8 flag bits (0.......)
+        sync_state = SYNC_FLAG;
+      } else
+        sync_state = SYNC_RESET;
+      break;
+
+    case SYNC_1:                              // last bit was a 1
+      if (!bit) {
+        sync_count++;
+        sync_state = SYNC_0;
+      } else if (sync_count > AIS_PREAMBLE_LENGTH) {
+        sync_count = 5;                       // already have 3 of 8 flag bits (011.....)
+        sync_state = SYNC_FLAG;
+      } else
+        sync_state = SYNC_RESET;
+      break;
+
+    case SYNC_FLAG:
+      sync_count--;
+      if (sync_count != 0) {
+        if (!bit)                             // expecting 1
+          sync_state = SYNC_RESET;
+      } else {
+        if (!bit)                             // last flag bit must be 0
+          return true;
+        sync_state = SYNC_RESET;
+      }
+      break;
+  }
+  return false;
+}
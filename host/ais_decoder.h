@@ -0,0 +1,154 @@
+/*
+ * Reentrant host port of the packet handler in aishling/ais.cpp.
+ * One decoder per received stream, fed with raw NRZI bits. Decoding rules
+ * (preamble length, start flag, stuff bits, CRC, length limit) are identical
+ * to ais_interrupt(), but without channel hopping.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define AIS_PREAMBLE_LENGTH  8    // minimum number of alternating bits for a valid preamble
+#define AIS_SYNC_TIMEOUT     16   // number of bits until sync detection restarts
+#define AIS_MAX_PACKET_BITS  1020 // longer packets are considered invalid
+
+class ais_decoder {
+public:
+  explicit ais_decoder(uint8_t channel = 0);
+
+  void reset();                   // restart sync detection, e.g. after a gap in the stream
+
+  // Decodes bit_count raw NRZI bits, first bit in LSB of first byte.
+  // Calls on_packet(const uint8_t *packet, size_t size) for every packet with
+  // valid CRC. Packet layout matches a FIFO packet in the firmware: channel
+  // byte, payload, 2 CRC bytes.
+  template <class F> void push(const uint8_t *raw, size_t bit_count, F &&on_packet);
+
+  uint8_t channel;
+  uint64_t bits = 0;              // processed bits
+  uint64_t packets = 0;           // packets with valid CRC
+  uint64_t errors_stuffbit = 0;   // invalid stuff bits
+  uint64_t errors_noend = 0;      // no end flag found
+  uint64_t errors_crc = 0;        // CRC errors
+
+private:
+  enum state_t : uint8_t { STATE_RESET, STATE_WAIT_FOR_SYNC, STATE_PREFETCH, STATE_RECEIVE_PACKET };
+  enum sync_t : uint8_t { SYNC_RESET, SYNC_0, SYNC_1, SYNC_FLAG };
+
+  template <class F> void push_bit(uint8_t nrzi, F &&on_packet);
+  bool wait_for_sync(uint8_t bit);
+
+  state_t state = STATE_RESET;
+  sync_t sync_state = SYNC_RESET;
+  uint16_t bitstream = 0;         // shift register with decoded bits
+  uint16_t bit_count = 0;         // bit counter for various purposes
+  uint16_t crc = 0;               // CCITT CRC of payload
+  uint8_t one_count = 0;          // counter of 1's to identify stuff bits
+  uint8_t data_byte = 0;          // byte being received
+  uint8_t prev_nrzi = 0;          // previous raw bit for NRZI decoding
+  uint8_t sync_count = 0;         // valid bits in current sync sequence
+  std::vector<uint8_t> packet;    // packet being received
+};
+
+template <class F>
+void ais_decoder::push(const uint8_t *raw, size_t bit_count, F &&on_packet)
+{
+  bits += bit_count;
+  size_t full_bytes = bit_count / 8;
+  for (size_t i = 0; i < full_bytes; i++) {
+    uint8_t byte = raw[i];
+    for (uint8_t b = 0; b < 8; b++, byte >>= 1)
+      push_bit(byte & 1, on_packet);
+  }
+  if (bit_count % 8) {
+    uint8_t byte = raw[full_bytes];
+    for (size_t b = 0; b < bit_count % 8; b++, byte >>= 1)
+      push_bit(byte & 1, on_packet);
+  }
+}
+
+template <class F>
+inline void ais_decoder::push_bit(uint8_t nrzi, F &&on_packet)
+{
+  uint8_t bit = !(prev_nrzi ^ nrzi);          // NRZI: no change = 1, change = 0
+  prev_nrzi = nrzi;
+
+  bitstream >>= 1;                            // receiving LSB first
+  if (bit)
+    bitstream |= 0x8000;
+
+  switch (state) {
+    case STATE_RESET:
+      bitstream &= 0x8000;                    // keep incoming bit
+      bit_count = 0;
+      packet.clear();
+      packet.push_back(channel);
+      sync_state = SYNC_RESET;
+      state = STATE_WAIT_FOR_SYNC;
+      break;
+
+    case STATE_WAIT_FOR_SYNC:
+      bit_count++;
+      if (wait_for_sync(bit)) {
+        bit_count = 0;
+        state = STATE_PREFETCH;
+      }
+      break;
+
+    case STATE_PREFETCH:                      // fill shift register with first 8 bits
+      if (++bit_count == 8) {
+        bit_count = 0;
+        one_count = 0;
+        data_byte = 0;
+        crc = 0xffff;
+        state = STATE_RECEIVE_PACKET;
+      }
+      break;
+
+    case STATE_RECEIVE_PACKET:
+      bit = bitstream & 0x80;                 // bit leaving the 8 bit look-ahead
+
+      if (one_count == 5) {                   // expecting stuff bit
+        if (bit) {
+          errors_stuffbit++;
+          state = STATE_RESET;
+        } else
+          one_count = 0;
+        break;
+      }
+
+      data_byte = data_byte >> 1 | bit;
+      if (bit) {
+        one_count++;
+        bit = 1;
+      } else
+        one_count = 0;
+
+      if (bit ^ (crc & 0x0001))               // CCITT CRC
+        crc = (crc >> 1) ^ 0x8408;
+      else
+        crc >>= 1;
+
+      if ((bit_count & 0x07) == 0x07) {       // every 8th bit
+        packet.push_back(data_byte);
+        data_byte = 0;
+      }
+      bit_count++;
+
+      if ((bitstream & 0xff00) == 0x7e00) {   // end flag
+        if (crc != 0xf0b8)
+          errors_crc++;
+        else {
+          packets++;
+          on_packet(packet.data(), packet.size());
+        }
+        state = STATE_RESET;
+      } else if (bit_count > AIS_MAX_PACKET_BITS) {
+        errors_noend++;
+        state = STATE_RESET;
+      }
+      break;
+  }
+}
@@ -0,0 +1,521 @@
+/*
+ * aisarchive: stores the receiver output in an ais_archive file and queries
+ * it. Input lines may start with a timestamp in seconds since the epoch
+ * followed by a space, e.g. from `ts '%.s'` or an older text log; lines
+ * without one are stamped with the time they are read.
+ *
+ * usage:
+ *   aisarchive write [-b records] [-f seconds] archive [input]
+ *     input          serial port or file, default stdin
+ *     -b N           records per block (default 4096)
+ *     -f SECONDS     write a partial block once its first record has waited
+ *                    this long (default 60), so a live archive stays current
+ *   aisarchive query [options] archive
+ *     --mmsi N       only this vessel
+ *     --type T,...   only these message types
+ *     --from TIME    seconds since the epoch or YYYY-MM-DDTHH:MM:SS (UTC)
+ *     --to TIME
+ *     --nmea         print !AIVDM sentences instead of decoded records
+ *     --count        print the number of matching records only
+ *   aisarchive bench [-n copies] [-d days] [-b records] [--same] sentences.nmea
+ *     builds a timestamped text log and an archive from copies of the input
+ *     spread over the given days, then times queries on both; every copy
+ *     gets its own MMSIs unless --same is given
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include "../aishling/payload.h"
+#include "ais_archive.h"
+#include "nmea_encoder.h"
+#include "nmea_ingest.h"
+
+typedef std::chrono::steady_clock clock_type;
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int)
+{
+  stop = 1;
+}
+
+static int64_t now_ms()
+{
+  timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// "<seconds>[.<fraction>] " at start of line, returns length of prefix or 0
+static size_t parse_timestamp(const char *line, size_t length, int64_t &time)
+{
+  size_t i = 0;
+  int64_t seconds = 0;
+  while (i < length && line[i] >= '0' && line[i] <= '9')
+    seconds = seconds * 10 + line[i++] - '0';
+  if (i == 0)
+    return 0;
+  int64_t ms = 0;
+  if (i < length && line[i] == '.') {
+    int digits = 0;
+    for (i++; i < length && line[i] >= '0' && line[i] <= '9'; i++)
+      if (digits < 3) {
+        ms = ms * 10 + line[i] - '0';
+        digits++;
+      }
+    for (; digits < 3; digits++)
+      ms *= 10;
+  }
+  if (i >= length || line[i] != ' ')
+    return 0;
+  time = seconds * 1000 + ms;
+  return i + 1;
+}
+
+// Passes the complete lines in data to ingest and on_packet(time, packet, size).
+// Returns the number of bytes consumed.
+template <class F>
+static size_t ingest_lines(nmea_ingest &ingest, const char *data, size_t size, int64_t arrival, F &&on_packet)
+{
+  size_t position = 0;
+  while (const char *end = (const char *)memchr(data + position, '\n', size - position)) {
+    const char *line = data + position;
+    size_t length = end - line + 1;
+    int64_t time = arrival;
+    size_t prefix = parse_timestamp(line, length, time);
+    ingest.push(line + prefix, length - prefix, [&](const uint8_t *packet, size_t packet_size) {
+      on_packet(time, packet, packet_size);
+    });
+    position += length;
+  }
+  return position;
+}
+
+// FIFO packet to archive: channel byte, payload, CRC not stored
+static void add_packet(archive_writer &writer, int64_t time, const uint8_t *packet, size_t size)
+{
+  writer.add(time, packet[0], ARCHIVE_RSSI_NA, packet + 1, size - 3);
+}
+
+static int open_input(const char *name)
+{
+  if (!name || !strcmp(name, "-"))
+    return 0;
+  int fd = open(name, O_RDONLY | O_NOCTTY);
+  if (fd < 0)
+    return -1;
+  termios tio;
+  if (isatty(fd) && tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B115200);    // ignored by USB CDC
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+static int write_archive(int argc, char **argv)
+{
+  archive_writer writer;
+  int64_t flush_ms = 60000;
+  const char *names[2] = {nullptr, nullptr};
+  int name_count = 0;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      writer.block_records = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+      flush_ms = atof(argv[++i]) * 1000;
+    else if (name_count < 2)
+      names[name_count++] = argv[i];
+  }
+  if (!names[0]) {
+    fprintf(stderr, "usage: aisarchive write [-b records] [-f seconds] archive [input]\n");
+    return 1;
+  }
+  if (!writer.open(names[0])) {
+    fprintf(stderr, "aisarchive: cannot open archive %s: %s\n", names[0], errno ? strerror(errno) : "not an archive");
+    return 1;
+  }
+  int fd = open_input(names[1]);
+  if (fd < 0) {
+    fprintf(stderr, "aisarchive: cannot open %s: %s\n", names[1], strerror(errno));
+    return 1;
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  nmea_ingest ingest;
+  std::vector<char> buffer(65536);
+  size_t used = 0;
+  int64_t pending_since = 0;                        // wall clock of first record of partial block
+  while (!stop) {
+    pollfd p = {fd, POLLIN, 0};
+    int ready = poll(&p, 1, 1000);
+    if (ready > 0) {
+      ssize_t n = read(fd, buffer.data() + used, buffer.size() - used);
+      if (n == 0)
+        break;
+      if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN)
+          continue;
+        fprintf(stderr, "aisarchive: read: %s\n", strerror(errno));
+        break;
+      }
+      used += n;
+      size_t consumed = ingest_lines(ingest, buffer.data(), used, now_ms(),
+                                     [&](int64_t time, const uint8_t *packet, size_t size) {
+                                       if (!writer.pending())
+                                         pending_since = now_ms();
+                                       add_packet(writer, time, packet, size);
+                                     });
+      if (consumed == 0 && used == buffer.size())
+        consumed = used;                            // no line end, drop garbage
+      memmove(buffer.data(), buffer.data() + consumed, used - consumed);
+      used -= consumed;
+    } else if (ready < 0 && errno != EINTR) {
+      break;
+    }
+    if (writer.pending() && now_ms() - pending_since >= flush_ms && !writer.flush())
+      fprintf(stderr, "aisarchive: write: %s\n", strerror(errno));
+  }
+  writer.close();
+  fprintf(stderr, "aisarchive: %llu records in %llu blocks, %llu lost, sentences %llu, checksum errors %llu, format errors %llu\n",
+          (unsigned long long)writer.records, (unsigned long long)writer.blocks, (unsigned long long)writer.records_lost,
+          (unsigned long long)ingest.sentences, (unsigned long long)ingest.errors_checksum,
+          (unsigned long long)(ingest.errors_format + ingest.errors_sequence + ingest.errors_length));
+  return 0;
+}
+
+// seconds since the epoch or YYYY-MM-DDTHH:MM:SS in UTC, in ms
+static bool parse_time(const char *text, int64_t &time)
+{
+  tm t = {};
+  const char *end = strptime(text, "%Y-%m-%dT%H:%M:%S", &t);
+  if (end && (*end == 0 || *end == 'Z')) {
+    time = (int64_t)timegm(&t) * 1000;
+    return true;
+  }
+  char *number_end;
+  double seconds = strtod(text, &number_end);
+  if (number_end == text || *number_end)
+    return false;
+  time = (int64_t)(seconds * 1000);
+  return true;
+}
+
+static void format_time(int64_t time, char *text, size_t size)
+{
+  time_t seconds = time / 1000;
+  tm t;
+  gmtime_r(&seconds, &t);
+  size_t n = strftime(text, size, "%Y-%m-%dT%H:%M:%S", &t);
+  snprintf(text + n, size - n, ".%03dZ", (int)(time % 1000));
+}
+
+static void print_record(const archive_record &r)
+{
+  char time[32];
+  format_time(r.time, time, sizeof(time));
+  printf("%s %c %9u %2u", time, 'A' + r.channel, r.mmsi, r.type);
+  ais_payload view = {r.payload, 0, 0xffff, (uint16_t)(r.size * 8)};
+  ais_report report;
+  if (ais_parse(view, report) && (report.flags & AIS_HAS_POSITION))
+    printf(" %10.5f %11.5f", report.lat / 600000.0, report.lon / 600000.0);
+  if (r.rssi != ARCHIVE_RSSI_NA)
+    printf(" %d dBm", r.rssi);
+  printf("\n");
+}
+
+static int query_archive(int argc, char **argv)
+{
+  archive_query q;
+  bool nmea = false, count_only = false;
+  const char *name = nullptr;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "--mmsi") && i + 1 < argc) {
+      q.mmsi = strtoul(argv[++i], nullptr, 10);
+    } else if (!strcmp(argv[i], "--type") && i + 1 < argc) {
+      q.type_mask = 0;
+      for (char *p = argv[++i]; *p;) {
+        q.type_mask |= archive_type_bit(strtoul(p, &p, 10));
+        if (*p == ',')
+          p++;
+        else
+          break;
+      }
+    } else if ((!strcmp(argv[i], "--from") || !strcmp(argv[i], "--to")) && i + 1 < argc) {
+      int64_t &time = argv[i][2] == 'f' ? q.from : q.to;
+      if (!parse_time(argv[++i], time)) {
+        fprintf(stderr, "aisarchive: bad time %s\n", argv[i]);
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "--nmea")) {
+      nmea = true;
+    } else if (!strcmp(argv[i], "--count")) {
+      count_only = true;
+    } else {
+      name = argv[i];
+    }
+  }
+  if (!name) {
+    fprintf(stderr, "usage: aisarchive query [--mmsi N] [--type T,...] [--from TIME] [--to TIME] [--nmea] [--count] archive\n");
+    return 1;
+  }
+  archive_reader reader;
+  if (!reader.open(name)) {
+    fprintf(stderr, "aisarchive: cannot open archive %s\n", name);
+    return 1;
+  }
+
+  nmea_encoder encoder;
+  std::string text;
+  uint8_t packet[NMEA_MAX_PACKET];
+  uint64_t matches = 0;
+  reader.scan(q, [&](const archive_record &r) {
+    matches++;
+    if (count_only)
+      return;
+    if (!nmea) {
+      print_record(r);
+      return;
+    }
+    packet[0] = r.channel;
+    memcpy(packet + 1, r.payload, r.size);
+    uint16_t crc = nmea_packet_crc(r.payload, r.size);
+    packet[r.size + 1] = crc & 0xff;
+    packet[r.size + 2] = crc >> 8;
+    text.clear();
+    encoder.encode(packet, r.size + 3, text);
+    fwrite(text.data(), 1, text.size(), stdout);
+  });
+  if (count_only)
+    printf("%llu\n", (unsigned long long)matches);
+  fprintf(stderr, "aisarchive: %llu records, read %llu of %llu blocks\n", (unsigned long long)matches,
+          (unsigned long long)reader.blocks_read, (unsigned long long)reader.blocks);
+  return 0;
+}
+
+static double seconds_since(clock_type::time_point start)
+{
+  return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// query on the text log: every line must be parsed, the MMSI is in the armored payload
+static uint64_t scan_text(const std::string &log, const archive_query &q)
+{
+  nmea_ingest ingest;
+  uint64_t matches = 0;
+  ingest_lines(ingest, log.data(), log.size(), 0, [&](int64_t time, const uint8_t *packet, size_t size) {
+    ais_payload view = {packet + 1, 0, 0xffff, (uint16_t)((size - 3) * 8)};
+    if (time >= q.from && time <= q.to && (!q.mmsi || (uint32_t)ais_get(view, AIS_MMSI) == q.mmsi) &&
+        (archive_type_bit(ais_get(view, AIS_TYPE)) & q.type_mask))
+      matches++;
+  });
+  return matches;
+}
+
+// replaces the MMSI in a FIFO packet, bits 8 to 37 of the payload
+static void set_mmsi(uint8_t *packet, size_t size, uint32_t mmsi)
+{
+  uint8_t *payload = packet + 1;
+  for (int bit = 0; bit < 30; bit++) {
+    uint8_t mask = 0x80 >> ((8 + bit) % 8);
+    if (mmsi >> (29 - bit) & 1)
+      payload[(8 + bit) / 8] |= mask;
+    else
+      payload[(8 + bit) / 8] &= ~mask;
+  }
+  uint16_t crc = nmea_packet_crc(payload, size - 3);
+  packet[size - 2] = crc & 0xff;
+  packet[size - 1] = crc >> 8;
+}
+
+static int bench(int argc, char **argv)
+{
+  int copies = 200;
+  double days = 90;
+  bool same = false;
+  size_t block_records = ARCHIVE_BLOCK_RECORDS;
+  const char *name = nullptr;
+  for (int i = 0; i < argc; i++) {
+    if (!strcmp(argv[i], "-n") && i + 1 < argc)
+      copies = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+      days = atof(argv[++i]);
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      block_records = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--same"))
+      same = true;
+    else
+      name = argv[i];
+  }
+  std::vector<char> input;
+  FILE *f = name ? fopen(name, "rb") : nullptr;
+  if (!f) {
+    fprintf(stderr, "usage: aisarchive bench [-n copies] [-d days] [-b records] [--same] sentences.nmea\n");
+    return 1;
+  }
+  char chunk[65536];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+    input.insert(input.end(), chunk, chunk + n);
+  fclose(f);
+  std::vector<std::vector<uint8_t>> packets;
+  nmea_ingest input_ingest;
+  input_ingest.push(input.data(), input.size(), [&](const uint8_t *packet, size_t size) {
+    if (size >= 8)                                  // holds an MMSI
+      packets.emplace_back(packet, packet + size);
+  });
+  if (packets.empty()) {
+    fprintf(stderr, "aisarchive: no messages in %s\n", name);
+    return 1;
+  }
+
+  // text log as written by `ts '%.s'`; unless --same, every copy has its own
+  // vessels, as if the traffic in view changed every copy
+  std::vector<std::string> lines;
+  nmea_encoder encoder;
+  std::string text;
+  for (int c = 0; c < copies; c++)
+    for (std::vector<uint8_t> packet : packets) {
+      if (!same) {
+        ais_payload view = {packet.data() + 1, 0, 0xffff, (uint16_t)((packet.size() - 3) * 8)};
+        set_mmsi(packet.data(), packet.size(), (ais_get(view, AIS_MMSI) + c * 1000000u) % 1000000000u);
+      }
+      text.clear();
+      encoder.encode(packet.data(), packet.size(), text);
+      for (size_t start = 0, end; (end = text.find('\n', start)) != std::string::npos; start = end + 1)
+        lines.push_back(text.substr(start, end + 1 - start));
+    }
+  const int64_t start = 1767225600000;              // 2026-01-01
+  size_t total = lines.size();
+  double step = days * 86400000.0 / total;
+  std::string log;
+  log.reserve(total * (lines[0].size() + 16));
+  for (size_t i = 0; i < total; i++) {
+    int64_t time = start + (int64_t)(i * step);
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%lld.%03d ", (long long)(time / 1000), (int)(time % 1000));
+    log += prefix;
+    log += lines[i];
+  }
+  lines.clear();
+
+  char archive_name[] = "/tmp/aisarchive-XXXXXX";
+  int fd = mkstemp(archive_name);
+  if (fd < 0) {
+    fprintf(stderr, "aisarchive: cannot create temporary file: %s\n", strerror(errno));
+    return 1;
+  }
+  close(fd);
+  auto t0 = clock_type::now();
+  {
+    archive_writer writer;
+    writer.block_records = block_records;
+    nmea_ingest ingest;
+    if (!writer.open(archive_name)) {
+      fprintf(stderr, "aisarchive: cannot open %s\n", archive_name);
+      return 1;
+    }
+    ingest_lines(ingest, log.data(), log.size(), 0, [&](int64_t time, const uint8_t *packet, size_t size) {
+      add_packet(writer, time, packet, size);
+    });
+  }
+  double write_seconds = seconds_since(t0);
+
+  archive_reader reader;
+  if (!reader.open(archive_name)) {
+    fprintf(stderr, "aisarchive: cannot read %s\n", archive_name);
+    return 1;
+  }
+  unlink(archive_name);                             // stays mapped
+  off_t archive_size = 0;
+  std::vector<uint32_t> mmsis;
+  reader.scan(archive_query(), [&](const archive_record &r) {
+    archive_size += sizeof(archive_record_header) + r.size;
+    mmsis.push_back(r.mmsi);
+  });
+  fprintf(stderr, "text log %.1f MB, %zu sentences over %.0f days; archive %llu records in %llu blocks, "
+          "%.1f MB, written in %.2f s\n",
+          log.size() / 1e6, total, days, (unsigned long long)reader.records, (unsigned long long)reader.blocks,
+          (archive_size + reader.blocks * sizeof(archive_block_header)) / 1e6, write_seconds);
+
+  struct bench_query {
+    std::string name;
+    archive_query q;
+  };
+  std::vector<bench_query> queries;
+  const int64_t end = start + (int64_t)(days * 86400000);
+  const int64_t middle = start + (end - start) / 2;
+  queries.push_back({"all, 1 hour", archive_query()});
+  queries.back().q.from = middle;
+  queries.back().q.to = middle + 3600000;
+  queries.push_back({"type 5, all", archive_query()});
+  queries.back().q.type_mask = archive_type_bit(5);
+  for (size_t k = 1; k <= 3; k++) {
+    uint32_t mmsi = mmsis[(mmsis.size() * k / 4 + k * 101) % mmsis.size()];   // not the same record of every copy
+    archive_query q;
+    q.mmsi = mmsi;
+    q.type_mask = archive_type_bit(1) | archive_type_bit(2) | archive_type_bit(3) | archive_type_bit(18);
+    queries.push_back({"positions " + std::to_string(mmsi) + ", all", q});
+    q.from = middle;
+    q.to = middle + 86400000;
+    queries.push_back({"positions " + std::to_string(mmsi) + ", 1 day", q});
+    q.to = middle + 3600000;
+    queries.push_back({"positions " + std::to_string(mmsi) + ", 1 hour", q});
+  }
+
+  fprintf(stderr, "%-30s %9s %10s %14s %10s %8s\n", "query", "records", "archive ms", "blocks read", "text ms",
+          "speedup");
+  bool ok = true;
+  for (const bench_query &b : queries) {
+    double archive_seconds = 1e9, text_seconds = 1e9;
+    uint64_t archive_matches = 0, text_matches = 0;
+    for (int repeat = 0; repeat < 3; repeat++) {    // best of 3, data in memory
+      reader.blocks_read = 0;
+      archive_matches = 0;
+      auto t = clock_type::now();
+      reader.scan(b.q, [&](const archive_record &) { archive_matches++; });
+      archive_seconds = std::min(archive_seconds, seconds_since(t));
+      t = clock_type::now();
+      text_matches = scan_text(log, b.q);
+      text_seconds = std::min(text_seconds, seconds_since(t));
+    }
+    char blocks[32];
+    snprintf(blocks, sizeof(blocks), "%llu/%llu", (unsigned long long)reader.blocks_read,
+             (unsigned long long)reader.blocks);
+    fprintf(stderr, "%-30s %9llu %10.3f %14s %10.1f %7.0fx\n", b.name.c_str(), (unsigned long long)archive_matches,
+            archive_seconds * 1e3, blocks, text_seconds * 1e3, text_seconds / archive_seconds);
+    if (archive_matches != text_matches) {
+      fprintf(stderr, "  mismatch: text log has %llu records\n", (unsigned long long)text_matches);
+      ok = false;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc >= 2 && !strcmp(argv[1], "write"))
+    return write_archive(argc - 2, argv + 2);
+  if (argc >= 2 && !strcmp(argv[1], "query"))
+    return query_archive(argc - 2, argv + 2);
+  if (argc >= 2 && !strcmp(argv[1], "bench"))
+    return bench(argc - 2, argv + 2);
+  fprintf(stderr, "usage: aisarchive write|query|bench ...\n");
+  return 1;
+}
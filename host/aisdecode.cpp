@@ -0,0 +1,153 @@
+/*
+ * aisdecode: decodes raw capture streams recorded from one or more AIShling
+ * receivers (capture mode, r/R command) and prints !AIVDM sentences.
+ * Every input file is one stream, streams are decoded in parallel.
+ *
+ * usage: aisdecode [-j threads] [--bench copies] capture...
+ *   -j N        number of worker threads, default: number of cores
+ *   --bench N   decode N copies of every input without output and report throughput
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ais_decoder.h"
+#include "capture_stream.h"
+#include "nmea_encoder.h"
+#include "thread_pool.h"
+
+#define STREAM_CHUNK_SIZE 65536   // bytes decoded per task before yielding to other streams
+
+struct stream {
+  std::string name;
+  const std::vector<uint8_t> *input;
+  size_t position = 0;
+  capture_parser parser;
+  ais_decoder decoders[2] = {ais_decoder(0), ais_decoder(1)};
+  nmea_encoder encoder;
+  std::string output;
+  uint64_t sentences = 0;
+};
+
+static std::mutex output_lock;
+static bool quiet = false;
+
+static bool read_file(const char *name, std::vector<uint8_t> &data)
+{
+  FILE *f = strcmp(name, "-") ? fopen(name, "rb") : stdin;
+  if (!f)
+    return false;
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  if (f != stdin)
+    fclose(f);
+  return true;
+}
+
+// decodes next chunk of stream and schedules the following one
+static void decode_chunk(thread_pool &pool, stream *s)
+{
+  size_t size = s->input->size() - s->position;
+  if (size > STREAM_CHUNK_SIZE)
+    size = STREAM_CHUNK_SIZE;
+
+  uint64_t gaps = s->parser.gaps;
+  s->parser.push(s->input->data() + s->position, size, [s, &gaps](const capture_frame &frame) {
+    ais_decoder &decoder = s->decoders[frame.channel];
+    if (s->parser.gaps != gaps) {     // bits are missing, don't join packets across the gap
+      gaps = s->parser.gaps;
+      decoder.reset();
+    }
+    decoder.push(frame.data, frame.size * 8, [s](const uint8_t *packet, size_t packet_size) {
+      s->sentences += s->encoder.encode(packet, packet_size, s->output);
+    });
+  });
+  s->position += size;
+
+  if (!quiet && !s->output.empty()) {
+    std::lock_guard<std::mutex> guard(output_lock);
+    fwrite(s->output.data(), 1, s->output.size(), stdout);
+  }
+  s->output.clear();
+
+  if (s->position < s->input->size())
+    pool.submit([&pool, s] { decode_chunk(pool, s); });
+}
+
+int main(int argc, char **argv)
+{
+  unsigned threads = std::thread::hardware_concurrency();
+  unsigned copies = 0;
+  std::vector<const char *> files;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--bench") && i + 1 < argc)
+      copies = atoi(argv[++i]);
+    else
+      files.push_back(argv[i]);
+  }
+  if (files.empty()) {
+    fprintf(stderr, "usage: aisdecode [-j threads] [--bench copies] capture...\n");
+    return 1;
+  }
+  if (threads == 0)
+    threads = 1;
+  quiet = copies > 0;
+
+  std::vector<std::vector<uint8_t>> inputs(files.size());
+  for (size_t i = 0; i < files.size(); i++)
+    if (!read_file(files[i], inputs[i])) {
+      fprintf(stderr, "aisdecode: cannot read %s\n", files[i]);
+      return 1;
+    }
+
+  std::vector<std::unique_ptr<stream>> streams;
+  for (unsigned copy = 0; copy < (copies ? copies : 1); copy++)
+    for (size_t i = 0; i < files.size(); i++) {
+      streams.emplace_back(new stream);
+      streams.back()->name = files[i];
+      streams.back()->input = &inputs[i];
+    }
+
+  auto start = std::chrono::steady_clock::now();
+  {
+    thread_pool pool(threads);
+    for (auto &s : streams) {
+      stream *p = s.get();
+      pool.submit([&pool, p] { decode_chunk(pool, p); });
+    }
+    pool.wait();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t bits = 0, packets = 0, sentences = 0, crc = 0, gaps = 0;
+  for (auto &s : streams) {
+    for (auto &d : s->decoders) {
+      bits += d.bits;
+      packets += d.packets;
+      crc += d.errors_crc;
+    }
+    sentences += s->sentences;
+    gaps += s->parser.gaps;
+  }
+
+  fprintf(stderr, "streams %zu, bits %llu, packets %llu, sentences %llu, crc errors %llu, gaps %llu\n",
+          streams.size(), (unsigned long long)bits, (unsigned long long)packets,
+          (unsigned long long)sentences, (unsigned long long)crc, (unsigned long long)gaps);
+  if (copies) {
+    double rate = bits / seconds;
+    fprintf(stderr, "threads %u, %.3f s, %.1f Mbit/s total, %.1f Mbit/s per core, %.0f channels at 9600 bit/s\n",
+            threads, seconds, rate / 1e6, rate / 1e6 / threads, rate / 9600);
+  }
+  return 0;
+}
@@ -0,0 +1,464 @@
+/*
+ * aisgen: synthetic AIS traffic for load testing. Simulates N vessels
+ * reporting at realistic rates on AIS channels A and B and writes the
+ * resulting radio bitstream in capture format (see aishling/capture.cpp),
+ * ready for aisdecode or the replay harness.
+ *
+ * Transmissions are HDLC framed (preamble, 0x7E flags, bit stuffing, CRC)
+ * and NRZI coded into 26.67ms slots. Idle slots carry random noise like the
+ * demodulator output without signal.
+ *
+ * usage: aisgen [options] > traffic.cap
+ *   -n N            number of vessels (default 100)
+ *   -t SECONDS      duration (default 60)
+ *   -o FILE         output file instead of stdout
+ *   --nmea FILE     also write transmitted messages as !AIVDM sentences
+ *   --ber RATE      random bit error rate (default 0)
+ *   --collisions P  probability a transmission ignores slot reservations (default 0.01)
+ *   --channels C    a, b or ab (default ab, alternating per transmission)
+ *   --seed N        random seed (default 1)
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "nmea_encoder.h"
+
+#define AIS_BIT_RATE     9600
+#define AIS_SLOT_BITS    256
+#define AIS_SLOTS_PER_MINUTE 2250
+#define CAPTURE_BLOCK_SIZE 16     // same block size as firmware
+
+// payload bit writer, fields are written MSB first
+struct bit_writer {
+  std::vector<uint8_t> bits;
+
+  void put(int64_t value, int count)
+  {
+    for (int i = count - 1; i >= 0; i--)
+      bits.push_back((value >> i) & 1);
+  }
+
+  void put_text(const char *text, int chars)
+  {
+    for (int i = 0; i < chars; i++) {
+      char c = *text ? *text++ : '@';     // pad with '@'
+      put(c >= 64 ? c - 64 : c, 6);
+    }
+  }
+
+  std::vector<uint8_t> bytes() const
+  {
+    std::vector<uint8_t> result((bits.size() + 7) / 8, 0);
+    for (size_t i = 0; i < bits.size(); i++)
+      if (bits[i])
+        result[i / 8] |= 0x80 >> (i % 8);
+    return result;
+  }
+};
+
+struct vessel {
+  uint32_t mmsi;
+  bool class_b;
+  double lat, lon;                // degrees
+  double sog, cog;                // knots, degrees
+  uint8_t status;                 // navigational status
+  uint8_t ship_type;
+  char name[21];
+  char callsign[8];
+  double next_position;           // time of next position report
+  double next_static;             // time of next static report
+  uint8_t next_channel;
+  uint8_t static_part;            // next type 24 part
+};
+
+struct transmission {
+  double time;
+  uint8_t channel;
+  std::vector<uint8_t> payload;   // payload bytes, MSB first
+  size_t payload_bits;
+};
+
+static std::mt19937_64 rng;
+
+static double uniform(double low, double high)
+{
+  return std::uniform_real_distribution<double>(low, high)(rng);
+}
+
+// reporting interval of position reports in seconds
+static double position_interval(const vessel &v)
+{
+  if (v.class_b)
+    return v.sog > 2 ? 30 : 180;
+  if (v.sog < 0.1)
+    return 180;                   // at anchor or moored
+  if (v.sog <= 14)
+    return 10;
+  if (v.sog <= 23)
+    return 6;
+  return 2;
+}
+
+static int64_t encode_lon(double lon) { return (int64_t)llround(lon * 600000); }
+static int64_t encode_lat(double lat) { return (int64_t)llround(lat * 600000); }
+
+static transmission position_report(const vessel &v, double time)
+{
+  bit_writer w;
+  int second = (int)fmod(time, 60);
+  if (!v.class_b) {
+    // mostly scheduled (1), some assigned scheduled (2) and interrogation responses (3)
+    int draw = std::uniform_int_distribution<int>(0, 9)(rng);
+    int type = draw > 1 ? 1 : draw ? 2 : 3;
+    w.put(type, 6);               // message type 1, 2 or 3, same layout
+    w.put(0, 2);                  // repeat
+    w.put(v.mmsi, 30);
+    w.put(v.status, 4);
+    w.put(-128, 8);               // rate of turn not available
+    w.put((int)(v.sog * 10), 10);
+    w.put(0, 1);                  // position accuracy
+    w.put(encode_lon(v.lon), 28);
+    w.put(encode_lat(v.lat), 27);
+    w.put((int)(v.cog * 10), 12);
+    w.put((int)v.cog, 9);         // true heading
+    w.put(second, 6);
+    w.put(0, 2);                  // maneuver
+    w.put(0, 3);                  // spare
+    w.put(0, 1);                  // RAIM
+    w.put(0, 19);                 // radio status
+  } else {
+    w.put(18, 6);
+    w.put(0, 2);
+    w.put(v.mmsi, 30);
+    w.put(0, 8);                  // reserved
+    w.put((int)(v.sog * 10), 10);
+    w.put(0, 1);
+    w.put(encode_lon(v.lon), 28);
+    w.put(encode_lat(v.lat), 27);
+    w.put((int)(v.cog * 10), 12);
+    w.put(511, 9);                // heading not available
+    w.put(second, 6);
+    w.put(0, 2);                  // reserved
+    w.put(1, 1);                  // CS unit
+    w.put(0, 1);                  // display
+    w.put(0, 1);                  // DSC
+    w.put(1, 1);                  // band
+    w.put(1, 1);                  // message 22
+    w.put(0, 1);                  // assigned
+    w.put(0, 1);                  // RAIM
+    w.put(0, 20);                 // radio status
+  }
+  return {time, 0, w.bytes(), w.bits.size()};
+}
+
+static transmission static_report(vessel &v, double time)
+{
+  bit_writer w;
+  if (!v.class_b) {
+    w.put(5, 6);
+    w.put(0, 2);
+    w.put(v.mmsi, 30);
+    w.put(0, 2);                  // AIS version
+    w.put(9000000 + v.mmsi % 1000000, 30);  // IMO number
+    w.put_text(v.callsign, 7);
+    w.put_text(v.name, 20);
+    w.put(v.ship_type, 8);
+    w.put(120, 9);                // dimension to bow
+    w.put(30, 9);                 // to stern
+    w.put(10, 6);                 // to port
+    w.put(10, 6);                 // to starboard
+    w.put(1, 4);                  // EPFD GPS
+    w.put(6, 4);                  // ETA month
+    w.put(15, 5);                 // day
+    w.put(12, 5);                 // hour
+    w.put(30, 6);                 // minute
+    w.put(85, 8);                 // draught 8.5m
+    w.put_text("ROTTERDAM", 20);
+    w.put(0, 1);                  // DTE
+    w.put(0, 1);                  // spare
+  } else if (v.static_part == 0) {
+    w.put(24, 6);
+    w.put(0, 2);
+    w.put(v.mmsi, 30);
+    w.put(0, 2);                  // part A
+    w.put_text(v.name, 20);
+    v.static_part = 1;
+  } else {
+    w.put(24, 6);
+    w.put(0, 2);
+    w.put(v.mmsi, 30);
+    w.put(1, 2);                  // part B
+    w.put(v.ship_type, 8);
+    w.put_text("AISGEN1", 7);     // vendor id
+    w.put_text(v.callsign, 7);
+    w.put(8, 9);
+    w.put(4, 9);
+    w.put(2, 6);
+    w.put(2, 6);
+    w.put(0, 6);                  // spare
+    v.static_part = 0;
+  }
+  return {time, 0, w.bytes(), w.bits.size()};
+}
+
+// raw NRZI bitstream of one channel, one byte per bit
+struct channel_stream {
+  std::vector<uint8_t> levels;
+  std::vector<uint8_t> slot_used;
+};
+
+// frames payload and writes it into the channel at bit position start
+static void render(const transmission &t, channel_stream &ch, size_t start, bool collide)
+{
+  // transmitted bit sequence: data bytes LSB first, then CRC
+  std::vector<uint8_t> data;
+  for (size_t i = 0; i < t.payload.size(); i++)
+    for (int b = 0; b < 8; b++)
+      data.push_back((t.payload[i] >> b) & 1);
+  uint16_t crc = 0xffff;
+  for (uint8_t bit : data)
+    crc = (bit ^ (crc & 1)) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+  crc ^= 0xffff;
+  for (int b = 0; b < 16; b++)
+    data.push_back((crc >> b) & 1);
+
+  std::vector<uint8_t> frame;
+  for (int i = 0; i < 8; i++)     // ramp up, transmitter settles
+    frame.push_back(1);
+  for (int i = 0; i < 24; i++)    // training sequence 0101..
+    frame.push_back(i & 1);
+  static const uint8_t flag[] = {0, 1, 1, 1, 1, 1, 1, 0};
+  frame.insert(frame.end(), flag, flag + 8);
+  int ones = 0;
+  for (uint8_t bit : data) {      // bit stuffing
+    frame.push_back(bit);
+    ones = bit ? ones + 1 : 0;
+    if (ones == 5) {
+      frame.push_back(0);
+      ones = 0;
+    }
+  }
+  frame.insert(frame.end(), flag, flag + 8);
+
+  // NRZI: 0 = change, 1 = no change
+  uint8_t level = start ? ch.levels[start - 1] : 0;
+  for (size_t i = 0; i < frame.size() && start + i < ch.levels.size(); i++) {
+    if (!frame[i])
+      level ^= 1;
+    uint8_t &out = ch.levels[start + i];
+    if (collide && (rng() & 1))
+      continue;                   // other transmitter wins this bit
+    out = level;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned vessels = 100;
+  double duration = 60;
+  const char *output_name = nullptr;
+  const char *nmea_name = nullptr;
+  double ber = 0;
+  double collisions = 0.01;
+  const char *channels = "ab";
+  unsigned long seed = 1;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!value) {
+      fprintf(stderr, "aisgen: missing value for %s\n", arg);
+      return 1;
+    }
+    i++;
+    if (!strcmp(arg, "-n"))
+      vessels = atoi(value);
+    else if (!strcmp(arg, "-t"))
+      duration = atof(value);
+    else if (!strcmp(arg, "-o"))
+      output_name = value;
+    else if (!strcmp(arg, "--nmea"))
+      nmea_name = value;
+    else if (!strcmp(arg, "--ber"))
+      ber = atof(value);
+    else if (!strcmp(arg, "--collisions"))
+      collisions = atof(value);
+    else if (!strcmp(arg, "--channels"))
+      channels = value;
+    else if (!strcmp(arg, "--seed"))
+      seed = strtoul(value, nullptr, 0);
+    else {
+      fprintf(stderr, "aisgen: unknown option %s\n", arg);
+      return 1;
+    }
+  }
+  rng.seed(seed);
+
+  // create fleet around a harbour
+  std::vector<vessel> fleet(vessels);
+  for (unsigned i = 0; i < vessels; i++) {
+    vessel &v = fleet[i];
+    v.mmsi = 244000000 + i * 7 + 1;
+    v.class_b = uniform(0, 1) < 0.3;
+    v.lat = 51.95 + uniform(-0.1, 0.1);
+    v.lon = 4.05 + uniform(-0.15, 0.15);
+    v.sog = uniform(0, 1) < 0.4 ? 0 : uniform(2, 25);
+    v.cog = uniform(0, 359.9);
+    v.status = v.sog > 0 ? 0 : 5;
+    v.ship_type = v.class_b ? 37 : 70;
+    snprintf(v.name, sizeof(v.name), "VESSEL %u", i + 1);
+    snprintf(v.callsign, sizeof(v.callsign), "PA%04u", i % 10000);
+    v.next_position = uniform(0, position_interval(v));
+    v.next_static = uniform(0, 360);
+    v.next_channel = strcmp(channels, "b") ? 0 : 1;
+    v.static_part = 0;
+  }
+
+  // collect all transmissions in time order
+  std::vector<transmission> transmissions;
+  for (double time = 0; time < duration; time += 0.1) {
+    for (vessel &v : fleet) {
+      bool position = time >= v.next_position;
+      bool stat = time >= v.next_static;
+      if (!position && !stat)
+        continue;
+      transmission t = position ? position_report(v, time) : static_report(v, time);
+      if (position) {
+        v.next_position += position_interval(v);
+        double distance = v.sog * position_interval(v) / 3600 / 60;     // degrees travelled
+        v.lat += distance * cos(v.cog * M_PI / 180);
+        v.lon += distance * sin(v.cog * M_PI / 180) / cos(v.lat * M_PI / 180);
+      } else
+        v.next_static += v.class_b && v.static_part ? 1 : 360;          // part B follows part A
+      t.channel = v.next_channel;
+      if (!strcmp(channels, "ab"))
+        v.next_channel ^= 1;
+      transmissions.push_back(t);
+    }
+  }
+
+  // place transmissions into slots
+  size_t total_bits = (size_t)(duration * AIS_BIT_RATE);
+  size_t total_slots = total_bits / AIS_SLOT_BITS;
+  channel_stream streams[2];
+  for (channel_stream &ch : streams) {
+    ch.levels.resize(total_slots * AIS_SLOT_BITS);
+    for (uint8_t &level : ch.levels)
+      level = rng() & 1;          // noise when nobody transmits
+    ch.slot_used.assign(total_slots, 0);
+  }
+
+  unsigned long sent = 0, collided = 0, dropped = 0;
+  nmea_encoder encoder;
+  std::string nmea;
+  for (const transmission &t : transmissions) {
+    channel_stream &ch = streams[t.channel];
+    size_t slots = (40 + t.payload_bits + 16 + t.payload_bits / 5 + 8 + AIS_SLOT_BITS - 1) / AIS_SLOT_BITS;
+    size_t nominal = (size_t)(t.time * AIS_SLOTS_PER_MINUTE / 60);
+
+    // pick a free slot near the nominal one, unless transmitter can't see the reservation
+    bool ignore = uniform(0, 1) < collisions;
+    size_t slot = SIZE_MAX;
+    for (size_t offset = 0; offset < 20 && slot == SIZE_MAX; offset++) {
+      size_t candidate = nominal + offset;
+      if (candidate + slots > total_slots)
+        break;
+      bool free = true;
+      for (size_t s = 0; s < slots; s++)
+        free = free && !ch.slot_used[candidate + s];
+      if (free || ignore)
+        slot = candidate;
+    }
+    if (slot == SIZE_MAX) {
+      dropped++;                  // channel saturated or end of recording
+      continue;
+    }
+
+    bool collide = false;
+    for (size_t s = 0; s < slots; s++) {
+      collide = collide || ch.slot_used[slot + s];
+      ch.slot_used[slot + s]++;
+    }
+    render(t, ch, slot * AIS_SLOT_BITS, collide);
+    sent++;
+    collided += collide ? 2 : 0;  // both transmissions are damaged
+
+    if (nmea_name) {
+      std::vector<uint8_t> packet;
+      packet.push_back(t.channel);
+      packet.insert(packet.end(), t.payload.begin(), t.payload.end());
+      packet.push_back(0);        // CRC is not encoded
+      packet.push_back(0);
+      encoder.encode(packet.data(), packet.size(), nmea);
+    }
+  }
+
+  // bit errors
+  unsigned long errors = 0;
+  if (ber > 0)
+    for (channel_stream &ch : streams) {
+      std::geometric_distribution<size_t> gap(ber);
+      for (size_t i = gap(rng); i < ch.levels.size(); i += gap(rng) + 1) {
+        ch.levels[i] ^= 1;
+        errors++;
+      }
+    }
+
+  // write capture frames, channels interleaved in time
+  FILE *out = output_name ? fopen(output_name, "wb") : stdout;
+  if (!out) {
+    fprintf(stderr, "aisgen: cannot write %s\n", output_name);
+    return 1;
+  }
+  uint16_t sequence[2] = {0, 0};
+  for (size_t bit = 0; bit + CAPTURE_BLOCK_SIZE * 8 <= total_slots * AIS_SLOT_BITS; bit += CAPTURE_BLOCK_SIZE * 8) {
+    uint32_t timestamp = (uint32_t)((uint64_t)bit * 1000000 / AIS_BIT_RATE);
+    for (uint8_t channel = 0; channel < 2; channel++) {
+      if (!strchr(channels, 'a' + channel))
+        continue;
+      uint8_t frame[10 + CAPTURE_BLOCK_SIZE + 1];
+      frame[0] = 0xA5;
+      frame[1] = 0x5A;
+      frame[2] = sequence[channel] & 0xff;
+      frame[3] = sequence[channel] >> 8;
+      frame[4] = channel;
+      frame[5] = CAPTURE_BLOCK_SIZE;
+      for (int i = 0; i < 4; i++)
+        frame[6 + i] = (timestamp >> (8 * i)) & 0xff;
+      for (int i = 0; i < CAPTURE_BLOCK_SIZE; i++) {
+        uint8_t byte = 0;
+        for (int b = 0; b < 8; b++)
+          byte |= streams[channel].levels[bit + i * 8 + b] << b;
+        frame[10 + i] = byte;
+      }
+      uint8_t check = 0;
+      for (size_t i = 2; i < sizeof(frame) - 1; i++)
+        check ^= frame[i];
+      frame[sizeof(frame) - 1] = check;
+      fwrite(frame, 1, sizeof(frame), out);
+      sequence[channel]++;
+    }
+  }
+  if (out != stdout)
+    fclose(out);
+
+  if (nmea_name) {
+    FILE *f = fopen(nmea_name, "wb");
+    if (!f) {
+      fprintf(stderr, "aisgen: cannot write %s\n", nmea_name);
+      return 1;
+    }
+    fwrite(nmea.data(), 1, nmea.size(), f);
+    fclose(f);
+  }
+
+  fprintf(stderr, "vessels %u, %.0f s, %lu messages (%.0f/min), %lu damaged by collisions, %lu not sent, %lu bit errors\n",
+          vessels, duration, sent, sent * 60 / duration, collided, dropped, errors);
+  return 0;
+}
@@ -0,0 +1,533 @@
+/*
+ * aismux: merges the !AIVDM output of several AIShling receivers.
+ * Reads N serial ports in one poll() loop, reassembles multi-sentence
+ * messages per port, drops messages already received by another receiver
+ * within a time window, and sends the merged stream to TCP clients and UDP
+ * destinations. Every TCP client has a bounded queue, a slow client loses
+ * messages instead of stalling the others. Ports that go away are reopened
+ * with a backoff.
+ *
+ * usage: aismux [options] port...
+ *   -t PORT          accept TCP clients on PORT
+ *   -u HOST:PORT     send messages as UDP datagrams, may be repeated
+ *   -w MS            duplicate window in milliseconds (default 2000)
+ *   -q BYTES         queue limit per TCP client (default 65536)
+ *   -i SECONDS       statistics interval (default 10)
+ *   --simulate N FILE RATE
+ *                    create N pseudo terminals fed from FILE at RATE sentences/s
+ *                    each, instead of opening real ports
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+typedef std::chrono::steady_clock clock_type;
+
+#define RETRY_MIN_MS    1000      // first attempt to reopen a port that went away
+#define RETRY_MAX_MS    30000     // attempts back off up to this interval
+
+static double elapsed_ms(clock_type::time_point from, clock_type::time_point to)
+{
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// message made of one or more sentences
+struct message {
+  std::string text;               // sentences including CR LF
+  clock_type::time_point received;// arrival of first sentence
+  uint64_t hash;                  // hash of payload for duplicate detection
+};
+
+// partially received multi-sentence message
+struct partial {
+  message msg;
+  int total;
+  int next;
+};
+
+struct source {
+  std::string name;
+  int fd = -1;
+  std::string line;               // incomplete line
+  std::map<std::pair<char, char>, partial> partials;  // keyed by message id, channel
+  unsigned long sentences = 0, messages = 0, duplicates = 0, errors = 0;
+  unsigned long last_sentences = 0;
+  clock_type::time_point retry_at;// next attempt to reopen while fd < 0
+  double retry_ms = RETRY_MIN_MS;
+};
+
+struct client {
+  explicit client(int fd) : fd(fd) {}
+
+  int fd;
+  std::string queue;              // bytes waiting to be sent
+  std::deque<std::pair<uint64_t, clock_type::time_point>> ends;   // per queued message: end in bytes queued, arrival
+  uint64_t queued = 0;            // bytes queued since connect
+  uint64_t written = 0;           // bytes written since connect
+  unsigned long dropped = 0;
+};
+
+static uint64_t fnv1a(const char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+  for (size_t i = 0; i < size; i++) {
+    hash ^= (uint8_t)data[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// splits sentence into fields, verifies checksum
+static bool parse_sentence(const std::string &line, std::vector<std::string> &fields)
+{
+  if (line.size() < 10 || line[0] != '!')
+    return false;
+  size_t star = line.rfind('*');
+  if (star == std::string::npos || star + 3 > line.size())
+    return false;
+  uint8_t crc = 0;
+  for (size_t i = 1; i < star; i++)
+    crc ^= line[i];
+  if (strtoul(line.substr(star + 1, 2).c_str(), nullptr, 16) != crc)
+    return false;
+
+  fields.clear();
+  size_t start = 1;
+  for (;;) {
+    size_t comma = line.find(',', start);
+    if (comma == std::string::npos || comma > star) {
+      fields.push_back(line.substr(start, star - start));
+      break;
+    }
+    fields.push_back(line.substr(start, comma - start));
+    start = comma + 1;
+  }
+  return fields.size() == 7 && (fields[0] == "AIVDM" || fields[0] == "AIVDO");
+}
+
+static int open_port(const char *name);
+
+class multiplexer {
+public:
+  std::vector<std::unique_ptr<source>> sources;
+  std::vector<std::unique_ptr<client>> clients;
+  std::vector<sockaddr_storage> udp_targets;
+  std::vector<socklen_t> udp_lengths;
+  int listen_fd = -1;
+  int udp_fd = -1;
+  double window_ms = 2000;
+  size_t queue_limit = 65536;
+  double stats_interval = 10;
+
+  void run();
+
+private:
+  void read_source(source &s, clock_type::time_point now);
+  void close_source(source &s, clock_type::time_point now);
+  void reopen_sources(clock_type::time_point now);
+  void handle_line(source &s, const std::string &line, clock_type::time_point now);
+  void dispatch(source &s, message &msg, clock_type::time_point now);
+  void expire(clock_type::time_point now);
+  void statistics(clock_type::time_point now);
+  void delivered(clock_type::time_point received);
+
+  std::unordered_map<uint64_t, clock_type::time_point> seen;   // recently sent payloads
+  std::deque<std::pair<clock_type::time_point, uint64_t>> seen_order;
+  unsigned long sent = 0;
+  unsigned long deliveries = 0;   // messages written to a client or sent to a UDP target
+  double latency_sum = 0, latency_max = 0;
+  clock_type::time_point last_stats = clock_type::now();
+};
+
+void multiplexer::run()
+{
+  std::vector<pollfd> fds;
+  for (;;) {
+    fds.clear();
+    for (auto &s : sources)
+      fds.push_back({s->fd, POLLIN, 0});          // ignored by poll() while closed
+    if (listen_fd >= 0)
+      fds.push_back({listen_fd, POLLIN, 0});
+    for (auto &c : clients)                     // POLLIN: clients send nothing, but hang up
+      fds.push_back({c->fd, (short)(c->queue.empty() ? POLLIN : POLLIN | POLLOUT), 0});
+
+    if (poll(fds.data(), fds.size(), 1000) < 0 && errno != EINTR) {
+      perror("poll");
+      return;
+    }
+    clock_type::time_point now = clock_type::now();
+
+    size_t index = 0;
+    for (auto &s : sources) {
+      if (fds[index].revents & (POLLIN | POLLHUP | POLLERR))
+        read_source(*s, now);
+      index++;
+    }
+    if (listen_fd >= 0) {
+      if (fds[index].revents & POLLIN) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0) {
+          fcntl(fd, F_SETFL, O_NONBLOCK);
+          clients.emplace_back(new client(fd));
+        }
+      }
+      index++;
+    }
+    for (size_t i = 0; i < clients.size() && index < fds.size(); i++, index++) {
+      client &c = *clients[i];
+      short revents = fds[index].revents;
+      bool closed = revents & (POLLHUP | POLLERR);
+      if (!closed && (revents & POLLIN)) {
+        char discard[256];
+        ssize_t n = read(c.fd, discard, sizeof(discard));
+        closed = n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR);
+      }
+      if (!closed && (revents & POLLOUT)) {
+        ssize_t n = write(c.fd, c.queue.data(), c.queue.size());
+        if (n > 0) {
+          c.queue.erase(0, n);
+          c.written += n;
+          while (!c.ends.empty() && c.ends.front().first <= c.written) {
+            delivered(c.ends.front().second);
+            c.ends.pop_front();
+          }
+        } else if (n < 0 && errno != EAGAIN && errno != EINTR)
+          closed = true;
+      }
+      if (closed) {
+        close(c.fd);
+        c.fd = -1;
+      }
+    }
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                 [](const std::unique_ptr<client> &c) { return c->fd < 0; }),
+                  clients.end());
+
+    reopen_sources(now);
+    expire(now);
+    if (elapsed_ms(last_stats, now) >= stats_interval * 1000)
+      statistics(now);
+  }
+}
+
+void multiplexer::read_source(source &s, clock_type::time_point now)
+{
+  char buffer[4096];
+  ssize_t n = read(s.fd, buffer, sizeof(buffer));
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (n <= 0) {                   // unplugged, or other end of pty closed
+    close_source(s, now);
+    return;
+  }
+  s.retry_ms = RETRY_MIN_MS;      // data again after reopening
+  for (ssize_t i = 0; i < n; i++) {
+    char c = buffer[i];
+    if (c == '\r' || c == '\n') {
+      if (!s.line.empty())
+        handle_line(s, s.line, now);
+      s.line.clear();
+    } else if (s.line.size() < 256)
+      s.line.push_back(c);
+  }
+}
+
+void multiplexer::close_source(source &s, clock_type::time_point now)
+{
+  close(s.fd);
+  s.fd = -1;
+  s.line.clear();
+  s.partials.clear();
+  s.retry_at = now + std::chrono::milliseconds((long)s.retry_ms);
+  fprintf(stderr, "%s: closed, reopening in %.0f s\n", s.name.c_str(), s.retry_ms / 1000);
+  s.retry_ms = std::min(s.retry_ms * 2, (double)RETRY_MAX_MS);
+}
+
+// tries to reopen ports that went away, e.g. a receiver plugged in again
+void multiplexer::reopen_sources(clock_type::time_point now)
+{
+  for (auto &s : sources) {
+    if (s->fd >= 0 || now < s->retry_at)
+      continue;
+    s->fd = open_port(s->name.c_str());
+    if (s->fd >= 0) {
+      fprintf(stderr, "%s: reopened\n", s->name.c_str());
+      continue;
+    }
+    s->retry_at = now + std::chrono::milliseconds((long)s->retry_ms);
+    s->retry_ms = std::min(s->retry_ms * 2, (double)RETRY_MAX_MS);
+  }
+}
+
+void multiplexer::handle_line(source &s, const std::string &line, clock_type::time_point now)
+{
+  std::vector<std::string> fields;
+  if (!parse_sentence(line, fields)) {
+    if (line[0] == '!')
+      s.errors++;
+    return;                       // status output of receiver, not forwarded
+  }
+  s.sentences++;
+
+  int total = atoi(fields[1].c_str());
+  int number = atoi(fields[2].c_str());
+  if (total == 1) {
+    message msg{line + "\r\n", now, fnv1a(fields[5].data(), fields[5].size())};
+    dispatch(s, msg, now);
+    return;
+  }
+
+  auto key = std::make_pair(fields[3].empty() ? '0' : fields[3][0], fields[4].empty() ? '?' : fields[4][0]);
+  if (number == 1)
+    s.partials[key] = partial{message{std::string(), now, 14695981039346656037ULL}, total, 1};
+  auto it = s.partials.find(key);
+  if (it == s.partials.end() || it->second.next != number || it->second.total != total) {
+    s.errors++;                   // fragment out of sequence
+    if (it != s.partials.end())
+      s.partials.erase(it);
+    return;
+  }
+  partial &p = it->second;
+  p.msg.text += line + "\r\n";
+  p.msg.hash = fnv1a(fields[5].data(), fields[5].size(), p.msg.hash);
+  p.next++;
+  if (number == total) {
+    message msg = p.msg;
+    s.partials.erase(it);
+    dispatch(s, msg, now);
+  }
+}
+
+void multiplexer::dispatch(source &s, message &msg, clock_type::time_point now)
+{
+  s.messages++;
+  if (seen.count(msg.hash)) {
+    s.duplicates++;
+    return;
+  }
+  seen[msg.hash] = now;
+  seen_order.push_back(std::make_pair(now, msg.hash));
+
+  for (auto &c : clients) {
+    if (c->queue.size() + msg.text.size() > queue_limit) {
+      c->dropped++;
+      continue;
+    }
+    c->queue += msg.text;
+    c->queued += msg.text.size();
+    c->ends.push_back(std::make_pair(c->queued, msg.received));
+  }
+  for (size_t i = 0; i < udp_targets.size(); i++)
+    if (sendto(udp_fd, msg.text.data(), msg.text.size(), MSG_DONTWAIT,
+               (const sockaddr *)&udp_targets[i], udp_lengths[i]) >= 0)
+      delivered(msg.received);
+  sent++;
+}
+
+// latency from arrival of the first sentence until the message left aismux
+void multiplexer::delivered(clock_type::time_point received)
+{
+  double latency = elapsed_ms(received, clock_type::now());
+  latency_sum += latency;
+  latency_max = std::max(latency_max, latency);
+  deliveries++;
+}
+
+// forget payloads older than the duplicate window and stale partial messages
+void multiplexer::expire(clock_type::time_point now)
+{
+  while (!seen_order.empty() && elapsed_ms(seen_order.front().first, now) > window_ms) {
+    auto it = seen.find(seen_order.front().second);
+    if (it != seen.end() && it->second == seen_order.front().first)
+      seen.erase(it);
+    seen_order.pop_front();
+  }
+  for (auto &s : sources)
+    for (auto it = s->partials.begin(); it != s->partials.end();)
+      if (elapsed_ms(it->second.msg.received, now) > window_ms) {
+        s->errors++;
+        it = s->partials.erase(it);
+      } else
+        ++it;
+}
+
+void multiplexer::statistics(clock_type::time_point now)
+{
+  double seconds = elapsed_ms(last_stats, now) / 1000;
+  last_stats = now;
+  for (auto &s : sources) {
+    fprintf(stderr, "%s: %.1f sentences/s, %lu messages, %lu duplicates, %lu errors%s\n", s->name.c_str(),
+            (s->sentences - s->last_sentences) / seconds, s->messages, s->duplicates, s->errors,
+            s->fd < 0 ? ", closed" : "");
+    s->last_sentences = s->sentences;
+  }
+  unsigned long dropped = 0;
+  for (auto &c : clients)
+    dropped += c->dropped;
+  fprintf(stderr, "merged: %lu messages, %lu deliveries, latency mean %.3f ms max %.3f ms, %zu clients, %lu dropped for slow clients\n",
+          sent, deliveries, deliveries ? latency_sum / deliveries : 0.0, latency_max, clients.size(), dropped);
+  latency_max = 0;
+}
+
+static int open_port(const char *name)
+{
+  int fd = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (fd < 0)
+    return -1;
+  termios tio;
+  if (tcgetattr(fd, &tio) == 0) {
+    cfmakeraw(&tio);
+    cfsetspeed(&tio, B115200);    // ignored by USB CDC
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+// feeds sentences from file into a pseudo terminal at a fixed rate
+static void simulate(int master, std::vector<std::string> lines, double rate, unsigned offset)
+{
+  auto interval = std::chrono::duration<double>(1.0 / rate);
+  auto next = clock_type::now();
+  for (size_t i = offset;; i++) {
+    const std::string &line = lines[i % lines.size()];
+    if (write(master, line.data(), line.size()) < 0 && errno != EAGAIN)
+      return;
+    next += std::chrono::duration_cast<clock_type::duration>(interval);
+    std::this_thread::sleep_until(next);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  multiplexer mux;
+  std::vector<std::string> ports;
+  std::vector<std::string> udp;
+  int tcp_port = 0;
+  unsigned simulate_count = 0;
+  const char *simulate_file = nullptr;
+  double simulate_rate = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool value = i + 1 < argc;
+    if (arg == "-t" && value)
+      tcp_port = atoi(argv[++i]);
+    else if (arg == "-u" && value)
+      udp.push_back(argv[++i]);
+    else if (arg == "-w" && value)
+      mux.window_ms = atof(argv[++i]);
+    else if (arg == "-q" && value)
+      mux.queue_limit = atol(argv[++i]);
+    else if (arg == "-i" && value)
+      mux.stats_interval = atof(argv[++i]);
+    else if (arg == "--simulate" && i + 3 < argc) {
+      simulate_count = atoi(argv[++i]);
+      simulate_file = argv[++i];
+      simulate_rate = atof(argv[++i]);
+    } else
+      ports.push_back(arg);
+  }
+  if (ports.empty() && !simulate_count) {
+    fprintf(stderr, "usage: aismux [-t port] [-u host:port] [-w ms] [-q bytes] [-i s] [--simulate n file rate] port...\n");
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  // pseudo terminals standing in for receivers
+  std::vector<std::thread> simulators;
+  if (simulate_count) {
+    std::vector<std::string> lines;
+    FILE *f = fopen(simulate_file, "r");
+    if (!f) {
+      fprintf(stderr, "aismux: cannot read %s\n", simulate_file);
+      return 1;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+      lines.push_back(line);
+    fclose(f);
+    for (unsigned i = 0; i < simulate_count; i++) {
+      int master = posix_openpt(O_RDWR | O_NOCTTY);
+      if (master < 0 || grantpt(master) || unlockpt(master)) {
+        perror("posix_openpt");
+        return 1;
+      }
+      ports.push_back(ptsname(master));
+      // receivers hear the same vessels, shifted a little
+      simulators.emplace_back(simulate, master, lines, simulate_rate, i * 3);
+    }
+  }
+
+  for (const std::string &name : ports) {
+    int fd = open_port(name.c_str());
+    if (fd < 0) {
+      fprintf(stderr, "aismux: cannot open %s: %s\n", name.c_str(), strerror(errno));
+      return 1;
+    }
+    mux.sources.emplace_back(new source);
+    mux.sources.back()->name = name;
+    mux.sources.back()->fd = fd;
+  }
+
+  if (tcp_port) {
+    mux.listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(mux.listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in6 address = {};
+    address.sin6_family = AF_INET6;
+    address.sin6_port = htons(tcp_port);
+    address.sin6_addr = in6addr_any;
+    if (bind(mux.listen_fd, (sockaddr *)&address, sizeof(address)) || listen(mux.listen_fd, 16)) {
+      perror("aismux: tcp");
+      return 1;
+    }
+    fcntl(mux.listen_fd, F_SETFL, O_NONBLOCK);
+  }
+
+  if (!udp.empty()) {
+    mux.udp_fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    int off = 0;
+    setsockopt(mux.udp_fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+    for (const std::string &target : udp) {
+      size_t colon = target.rfind(':');
+      addrinfo hints = {}, *result;
+      hints.ai_family = AF_INET6;
+      hints.ai_flags = AI_V4MAPPED;
+      hints.ai_socktype = SOCK_DGRAM;
+      if (colon == std::string::npos ||
+          getaddrinfo(target.substr(0, colon).c_str(), target.substr(colon + 1).c_str(), &hints, &result)) {
+        fprintf(stderr, "aismux: invalid UDP destination %s\n", target.c_str());
+        return 1;
+      }
+      sockaddr_storage storage = {};
+      memcpy(&storage, result->ai_addr, result->ai_addrlen);
+      mux.udp_targets.push_back(storage);
+      mux.udp_lengths.push_back(result->ai_addrlen);
+      freeaddrinfo(result);
+    }
+  }
+
+  mux.run();
+  return 1;
+}
@@ -0,0 +1,53 @@
+#include "capture_stream.h"
+
+// finds next valid frame in pending bytes, returns false if more bytes are needed
+bool capture_parser::next_frame(capture_frame &frame)
+{
+  while (position + CAPTURE_HEADER_SIZE + 1 <= pending.size()) {
+    const uint8_t *p = pending.data() + position;
+
+    // search sync sequence
+    if (p[0] != CAPTURE_SYNC_0 || p[1] != CAPTURE_SYNC_1) {
+      position++;
+      skipped++;
+      continue;
+    }
+
+    size_t size = p[5];
+    if (position + CAPTURE_HEADER_SIZE + size + 1 > pending.size())
+      return false;               // frame incomplete
+
+    uint8_t check = 0;
+    for (size_t i = 2; i < CAPTURE_HEADER_SIZE + size; i++)
+      check ^= p[i];
+    if (check != p[CAPTURE_HEADER_SIZE + size] || p[4] > 1) {
+      bad_frames++;               // sync sequence was part of data, keep searching
+      position++;
+      skipped++;
+      continue;
+    }
+
+    frame.sequence = p[2] | (p[3] << 8);
+    frame.channel = p[4];
+    frame.size = p[5];
+    frame.timestamp = p[6] | (p[7] << 8) | (p[8] << 16) | ((uint32_t)p[9] << 24);
+    frame.data = p + CAPTURE_HEADER_SIZE;
+    position += CAPTURE_HEADER_SIZE + size + 1;
+
+    // sequence numbers are counted per channel
+    if (have_sequence[frame.channel])
+      gaps += (uint16_t)(frame.sequence - next_sequence[frame.channel]);
+    have_sequence[frame.channel] = true;
+    next_sequence[frame.channel] = frame.sequence + 1;
+    frames++;
+    return true;
+  }
+  return false;
+}
+
+// drops consumed bytes
+void capture_parser::compact()
+{
+  pending.erase(pending.begin(), pending.begin() + position);
+  position = 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * Parser for the raw capture frames sent by the firmware in capture mode,
+ * see aishling/capture.cpp for the frame layout.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define CAPTURE_SYNC_0      0xA5
+#define CAPTURE_SYNC_1      0x5A
+#define CAPTURE_HEADER_SIZE 10
+#define CAPTURE_MAX_DATA    255
+
+struct capture_frame {
+  uint16_t sequence;
+  uint8_t channel;            // 0=A, 1=B
+  uint8_t size;               // number of bytes in data
+  uint32_t timestamp;         // device micros() of first bit
+  const uint8_t *data;        // raw NRZI bits, first bit in LSB
+};
+
+// Incremental frame scanner. Bytes may be fed in arbitrary chunks, frames are
+// resynchronised on the sync bytes and verified with the check byte.
+class capture_parser {
+public:
+  // Feeds bytes, calls on_frame(const capture_frame&) for every valid frame.
+  // Frame data is only valid during the call.
+  template <class F> void push(const uint8_t *bytes, size_t count, F &&on_frame);
+
+  uint64_t frames = 0;        // valid frames
+  uint64_t gaps = 0;          // frames missing according to sequence numbers
+  uint64_t bad_frames = 0;    // frames failing the check byte
+  uint64_t skipped = 0;       // bytes skipped while searching for sync
+
+private:
+  bool next_frame(capture_frame &frame);
+  void compact();
+
+  std::vector<uint8_t> pending;   // received bytes not consumed yet
+  size_t position = 0;            // scan position in pending
+  bool have_sequence[2] = {false, false};
+  uint16_t next_sequence[2] = {0, 0};
+};
+
+template <class F>
+void capture_parser::push(const uint8_t *bytes, size_t count, F &&on_frame)
+{
+  pending.insert(pending.end(), bytes, bytes + count);
+  capture_frame frame;
+  while (next_frame(frame))
+    on_frame(frame);
+  compact();
+}
@@ -0,0 +1,76 @@
+/*
+ * Minimal host implementation of the Arduino API, enough to compile the
+ * firmware modules (ais.cpp, fifo.cpp, nmea.cpp, capture.cpp) for replay
+ * and benchmarking on the PC. Time and pins are driven by the harness.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#define HIGH 1
+#define LOW  0
+#define INPUT  0
+#define OUTPUT 1
+#define RISING 3
+
+#define BIN 2
+#define OCT 8
+#define DEC 10
+#define HEX 16
+
+#define TXLED0
+#define TXLED1
+#define RXLED0
+#define RXLED1
+
+#define PROGMEM
+#define pgm_read_byte(p)      (*(const uint8_t *)(p))
+#define pgm_read_byte_near(p) (*(const uint8_t *)(p))
+#define memcpy_P memcpy
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+class hal_serial {
+public:
+  operator bool() const { return true; }
+
+  int available();
+  int read();
+
+  size_t write(uint8_t c);
+  size_t write(const uint8_t *data, size_t size);
+
+  size_t print(const char *s);
+  size_t print(const __FlashStringHelper *s) { return print((const char *)s); }
+  size_t print(char c);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+
+  template <class T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  template <class T> size_t println(T value, int base) { size_t n = print(value, base); return n + println(); }
+  size_t println() { return print("\r\n"); }
+
+  std::string output;             // everything written by the firmware
+  std::string input;              // bytes the firmware will read
+};
+
+extern hal_serial Serial;
+
+// harness controlled state
+extern uint32_t hal_micros;       // current time in microseconds
+extern uint8_t hal_pins[32];      // input pin levels
+
+inline unsigned long micros() { return hal_micros; }
+inline unsigned long millis() { return hal_micros / 1000; }
+inline int digitalRead(int pin) { return hal_pins[pin]; }
+inline void digitalWrite(int pin, int value) { hal_pins[pin] = value; }
+inline void pinMode(int, int) {}
+inline void noInterrupts() {}
+inline void interrupts() {}
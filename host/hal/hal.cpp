@@ -0,0 +1,68 @@
+#include "Arduino.h"
+
+#include <cstdio>
+
+hal_serial Serial;
+uint32_t hal_micros;
+uint8_t hal_pins[32];
+
+int hal_serial::available()
+{
+  return (int)input.size();
+}
+
+int hal_serial::read()
+{
+  if (input.empty())
+    return -1;
+  int c = (uint8_t)input[0];
+  input.erase(0, 1);
+  return c;
+}
+
+size_t hal_serial::write(uint8_t c)
+{
+  output.push_back((char)c);
+  return 1;
+}
+
+size_t hal_serial::write(const uint8_t *data, size_t size)
+{
+  output.append((const char *)data, size);
+  return size;
+}
+
+size_t hal_serial::print(const char *s)
+{
+  size_t n = strlen(s);
+  output.append(s, n);
+  return n;
+}
+
+size_t hal_serial::print(char c)
+{
+  output.push_back(c);
+  return 1;
+}
+
+size_t hal_serial::print(long n, int base)
+{
+  if (n < 0 && base == DEC) {
+    output.push_back('-');
+    return 1 + print((unsigned long)-n, base);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t hal_serial::print(unsigned long n, int base)
+{
+  char buffer[sizeof(unsigned long) * 8 + 1];
+  char *p = buffer + sizeof(buffer);
+  *--p = 0;
+  do {
+    unsigned digit = n % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n);
+  return print(p);
+}
@@ -0,0 +1,109 @@
+/*
+ * ingestbench: measures nmea_ingest throughput on a file of receiver output
+ * (e.g. aisgen --nmea or a log of the serial port). Every thread parses its
+ * own copy of the input, so the result scales with the number of cores.
+ *
+ * usage: ingestbench [-j threads] [-r repeats] [--scalar] sentences.nmea
+ *   -j N        number of threads, default: number of cores
+ *   -r N        passes over the input per thread, default 100
+ *   --scalar    use the scalar code even if SIMD is compiled in
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "nmea_ingest.h"
+
+struct result {
+  uint64_t sentences = 0;
+  uint64_t packets = 0;
+  uint64_t errors = 0;
+  uint64_t hash = 0;              // over all packet bytes, compares scalar and SIMD
+};
+
+static bool read_file(const char *name, std::vector<char> &data)
+{
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return false;
+  char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(f);
+  return true;
+}
+
+static void run(const std::vector<char> &input, int repeats, bool simd, result &r)
+{
+  nmea_ingest ingest;
+  ingest.simd = simd;
+  uint64_t hash = 14695981039346656037ULL;
+  for (int i = 0; i < repeats; i++) {
+    ingest.push(input.data(), input.size(), [&](const uint8_t *packet, size_t size) {
+      for (size_t b = 0; b < size; b++)
+        hash = (hash ^ packet[b]) * 1099511628211ULL;   // FNV-1a
+    });
+    ingest.reset();
+  }
+  r.sentences = ingest.sentences;
+  r.packets = ingest.packets;
+  r.errors = ingest.errors_checksum + ingest.errors_format + ingest.errors_sequence + ingest.errors_length;
+  r.hash = hash;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned threads = std::thread::hardware_concurrency();
+  int repeats = 100;
+  bool simd = NMEA_INGEST_SIMD;
+  const char *name = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      repeats = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--scalar"))
+      simd = false;
+    else
+      name = argv[i];
+  }
+  std::vector<char> input;
+  if (!name || !read_file(name, input)) {
+    fprintf(stderr, "usage: ingestbench [-j threads] [-r repeats] [--scalar] sentences.nmea\n");
+    return 1;
+  }
+  if (threads == 0)
+    threads = 1;
+  if (!input.empty() && input.back() != '\n')
+    input.push_back('\n');
+
+  std::vector<result> results(threads);
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; t++)
+    workers.emplace_back(run, std::cref(input), repeats, simd, std::ref(results[t]));
+  for (auto &w : workers)
+    w.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t sentences = 0, packets = 0;
+  for (const result &r : results) {
+    sentences += r.sentences;
+    packets += r.packets;
+  }
+  const result &first = results[0];
+  fprintf(stderr, "%s, per pass: sentences %llu, messages %llu, errors %llu (hash %016llx)\n",
+          simd ? "simd" : "scalar", (unsigned long long)(first.sentences / repeats),
+          (unsigned long long)(first.packets / repeats), (unsigned long long)(first.errors / repeats),
+          (unsigned long long)first.hash);
+  double rate = sentences / seconds;
+  fprintf(stderr, "threads %u, %.3f s, %.1f M sentences/s total, %.1f M sentences/s per core, %.0f MB/s per core\n",
+          threads, seconds, rate / 1e6, rate / 1e6 / threads,
+          (double)input.size() * repeats * threads / seconds / 1e6 / threads);
+  return 0;
+}
@@ -0,0 +1,82 @@
+#include "nmea_encoder.h"
+
+static const char nmea_hex[] = "0123456789ABCDEF";
+
+// encodes payload bytes as 6-bit characters, returns # of stuff bits
+static uint8_t nmea_push_payload(const uint8_t *payload, size_t size, std::string &out, uint8_t &crc)
+{
+  uint32_t bits = 0;
+  uint8_t bit_count = 0;
+
+  for (size_t i = 0; i < size; i++) {
+    bits = (bits << 8) | payload[i];
+    bit_count += 8;
+    while (bit_count >= 6) {
+      bit_count -= 6;
+      uint8_t c = (bits >> bit_count) & 0x3f;
+      c += (c > 39) ? 56 : 48;
+      crc ^= c;
+      out.push_back(c);
+    }
+  }
+
+  if (bit_count == 0)
+    return 0;
+  uint8_t stuff_bits = 6 - bit_count;
+  uint8_t c = (bits << stuff_bits) & 0x3f;
+  c += (c > 39) ? 56 : 48;
+  crc ^= c;
+  out.push_back(c);
+  return stuff_bits;
+}
+
+size_t nmea_encoder::encode(const uint8_t *packet, size_t size, std::string &out)
+{
+  if (size < 4)                   // channel, at least one payload byte and CRC
+    return 0;
+
+  char channel = packet[0] + 'A';
+  const uint8_t *payload = packet + 1;
+  size_t payload_size = size - 3;
+
+  size_t total_fragments = (payload_size + NMEA_MAX_AIS_PAYLOAD - 1) / NMEA_MAX_AIS_PAYLOAD;
+  if (total_fragments > 9)        // avoid sending garbage
+    return 0;
+
+  if (total_fragments > 1) {
+    message_id++;
+    if (message_id > 9)
+      message_id = 1;
+  }
+
+  for (size_t fragment = 1; fragment <= total_fragments; fragment++) {
+    size_t start = out.size();
+    out += "!AIVDM,";
+    out.push_back(total_fragments + '0');
+    out.push_back(',');
+    out.push_back(fragment + '0');
+    out.push_back(',');
+    if (total_fragments > 1)
+      out.push_back(message_id + '0');
+    out.push_back(',');
+    out.push_back(channel);
+    out.push_back(',');
+
+    size_t fragment_size = payload_size > NMEA_MAX_AIS_PAYLOAD ? NMEA_MAX_AIS_PAYLOAD : payload_size;
+    uint8_t crc = 0;
+    for (size_t i = start + 1; i < out.size(); i++)
+      crc ^= out[i];
+    uint8_t stuff_bits = nmea_push_payload(payload, fragment_size, out, crc);
+    payload += fragment_size;
+    payload_size -= fragment_size;
+
+    out.push_back(',');
+    out.push_back(stuff_bits + '0');
+    crc ^= ',' ^ (stuff_bits + '0');
+    out.push_back('*');
+    out.push_back(nmea_hex[crc >> 4]);
+    out.push_back(nmea_hex[crc & 0x0f]);
+    out += "\r\n";
+  }
+  return total_fragments;
+}
@@ -0,0 +1,21 @@
+/*
+ * Host port of aishling/nmea.cpp. Produces the same !AIVDM sentences,
+ * including fragmenting and message id sequence, as nmea_process_packet().
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define NMEA_MAX_AIS_PAYLOAD 42   // AIS bytes per sentence, same as firmware
+
+class nmea_encoder {
+public:
+  // Appends sentence(s) for a FIFO packet (channel byte, payload, CRC) to out,
+  // each terminated with CR LF. Returns number of sentences.
+  size_t encode(const uint8_t *packet, size_t size, std::string &out);
+
+private:
+  uint8_t message_id = 0;         // sequential id for multi-sentence messages
+};
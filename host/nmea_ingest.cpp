@@ -0,0 +1,253 @@
+#include "nmea_ingest.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// hex digit value, -1 if invalid
+static int hex_value(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+uint8_t nmea_checksum(const char *data, size_t size, bool simd)
+{
+  uint8_t crc = 0;
+  size_t i = 0;
+#if defined(__SSE2__)
+  if (simd && size >= 16) {
+    __m128i x = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16)
+      x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)(data + i)));
+    x = _mm_xor_si128(x, _mm_srli_si128(x, 8));   // fold 16 bytes into one
+    x = _mm_xor_si128(x, _mm_srli_si128(x, 4));
+    x = _mm_xor_si128(x, _mm_srli_si128(x, 2));
+    x = _mm_xor_si128(x, _mm_srli_si128(x, 1));
+    crc = (uint8_t)_mm_cvtsi128_si32(x);
+  }
+#else
+  (void)simd;
+#endif
+  for (; i < size; i++)
+    crc ^= data[i];
+  return crc;
+}
+
+bool nmea_dearmor(const char *text, size_t chars, uint8_t *out, bool simd)
+{
+  size_t i = 0;
+#if defined(__SSSE3__)
+  if (simd) {
+    // 16 characters to 12 bytes, as in vectorised base64 decoding
+    const __m128i below_digits = _mm_set1_epi8('0' - 1);
+    const __m128i above_upper = _mm_set1_epi8('W' + 1);
+    const __m128i below_lower = _mm_set1_epi8('`' - 1);
+    const __m128i above_lower = _mm_set1_epi8('w' + 1);
+    const __m128i offset = _mm_set1_epi8('0');
+    const __m128i gap = _mm_set1_epi8(40);
+    const __m128i gap_size = _mm_set1_epi8(8);
+    const __m128i merge_pairs = _mm_set1_epi32(0x01400140);
+    const __m128i merge_quads = _mm_set1_epi32(0x00011000);
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    for (; i + 16 <= chars; i += 16) {
+      __m128i c = _mm_loadu_si128((const __m128i *)(text + i));
+      __m128i valid = _mm_or_si128(
+        _mm_and_si128(_mm_cmpgt_epi8(c, below_digits), _mm_cmplt_epi8(c, above_upper)),
+        _mm_and_si128(_mm_cmpgt_epi8(c, below_lower), _mm_cmplt_epi8(c, above_lower)));
+      if (_mm_movemask_epi8(valid) != 0xffff)
+        return false;
+      __m128i v = _mm_sub_epi8(c, offset);
+      v = _mm_sub_epi8(v, _mm_and_si128(_mm_cmpgt_epi8(v, gap), gap_size));
+      v = _mm_maddubs_epi16(v, merge_pairs);        // 12 bit pairs
+      v = _mm_madd_epi16(v, merge_quads);           // 24 bit quads
+      _mm_storeu_si128((__m128i *)(out + i / 16 * 12), _mm_shuffle_epi8(v, order));
+    }
+  }
+#else
+  (void)simd;
+#endif
+  uint8_t *p = out + i / 16 * 12;                   // SIMD blocks end on a byte boundary
+  uint32_t bits = 0;
+  uint8_t bit_count = 0;
+  for (; i < chars; i++) {
+    uint8_t c = text[i];
+    if (c < '0' || c > 'w' || (c > 'W' && c < '`'))
+      return false;
+    uint8_t value = c - '0';
+    if (value > 40)
+      value -= 8;
+    bits = bits << 6 | value;
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      *p++ = bits >> bit_count;
+    }
+  }
+  if (bit_count)
+    *p = bits << (8 - bit_count);
+  return true;
+}
+
+// CRC-16/X.25 table, reflected polynomial 0x8408 as in the decoder
+struct crc_table {
+  uint16_t entry[256];
+  crc_table()
+  {
+    for (int i = 0; i < 256; i++) {
+      uint16_t crc = i;
+      for (int b = 0; b < 8; b++)
+        crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+      entry[i] = crc;
+    }
+  }
+};
+
+uint16_t nmea_packet_crc(const uint8_t *payload, size_t size)
+{
+  static const crc_table table;
+  uint16_t crc = 0xffff;
+  for (size_t i = 0; i < size; i++)
+    crc = (crc >> 8) ^ table.entry[(crc ^ payload[i]) & 0xff];
+  return crc ^ 0xffff;
+}
+
+void nmea_ingest::reset()
+{
+  for (auto &id : messages)
+    for (auto &m : id)
+      m.total = 0;
+}
+
+// adds the bits of one fragment to the message
+bool nmea_ingest::append(message &m, const char *text, size_t chars, uint8_t fill_bits)
+{
+  size_t bits = chars * 6;
+  if (fill_bits > bits || m.bits + bits - fill_bits > (NMEA_MAX_PACKET - 3) * 8) {
+    errors_length++;
+    return false;
+  }
+  uint8_t *data = m.data + 1;                       // after channel byte
+  if (m.bits % 8 == 0) {                            // always the case for firmware output
+    if (!nmea_dearmor(text, chars, data + m.bits / 8, simd)) {
+      errors_format++;
+      return false;
+    }
+  } else {                                          // previous fragment ended within a byte
+    uint8_t buffer[NMEA_MAX_PACKET + NMEA_DEARMOR_SLACK];
+    if (!nmea_dearmor(text, chars, buffer, simd)) {
+      errors_format++;
+      return false;
+    }
+    uint8_t shift = m.bits % 8;
+    uint8_t *p = data + m.bits / 8;
+    *p &= 0xff << (8 - shift);
+    for (size_t i = 0; i < (bits + 7) / 8; i++) {
+      p[i] |= buffer[i] >> shift;
+      p[i + 1] = buffer[i] << (8 - shift);
+    }
+  }
+  m.bits += bits - fill_bits;
+  return true;
+}
+
+// completes FIFO packet: clears bits after the payload, appends CRC
+const uint8_t *nmea_ingest::finish(message &m, uint8_t channel, size_t &packet_size)
+{
+  size_t bytes = (m.bits + 7) / 8;
+  if (bytes == 0) {
+    errors_format++;
+    return nullptr;
+  }
+  if (m.bits % 8)
+    m.data[bytes] &= 0xff << (8 - m.bits % 8);
+  m.data[0] = channel;
+  uint16_t crc = nmea_packet_crc(m.data + 1, bytes);
+  m.data[bytes + 1] = crc & 0xff;                   // transmitted LSB first
+  m.data[bytes + 2] = crc >> 8;
+  packet_size = bytes + 3;
+  m.total = 0;
+  return m.data;
+}
+
+// !AIVDM,<total>,<fragment>,<id>,<channel>,<payload>,<fill bits>*<checksum>
+const uint8_t *nmea_ingest::parse(const char *line, size_t length, size_t &packet_size)
+{
+  if (length < 22 || memcmp(line, "!AIVDM,", 7)) {
+    other++;
+    return nullptr;
+  }
+  const char *star = line + length - 3;
+  int high = hex_value(star[1]), low = hex_value(star[2]);
+  if (*star != '*' || high < 0 || low < 0) {
+    errors_format++;
+    return nullptr;
+  }
+  if (nmea_checksum(line + 1, star - line - 1, simd) != (high << 4 | low)) {
+    errors_checksum++;
+    return nullptr;
+  }
+  sentences++;
+
+  // fixed part up to payload
+  const char *p = line + 7;
+  uint8_t total = p[0] - '0';
+  uint8_t fragment = p[2] - '0';
+  if (p[1] != ',' || p[3] != ',' || total < 1 || total > NMEA_MAX_FRAGMENTS ||
+      fragment < 1 || fragment > total) {
+    errors_format++;
+    return nullptr;
+  }
+  p += 4;
+  uint8_t id = 0;
+  if (*p != ',')
+    id = *p++ - '0';
+  if (id > 9 || p[0] != ',' || (p[1] != 'A' && p[1] != 'B') || p[2] != ',') {
+    errors_format++;
+    return nullptr;
+  }
+  uint8_t channel = p[1] - 'A';
+  const char *payload = p + 3;
+  const char *comma = star - 2;                     // ,<fill bits> before checksum
+  uint8_t fill_bits = comma[1] - '0';
+  if (comma < payload || *comma != ',' || fill_bits > 5) {
+    errors_format++;
+    return nullptr;
+  }
+  size_t chars = comma - payload;
+
+  if (total == 1) {
+    single.bits = 0;
+    if (!append(single, payload, chars, fill_bits))
+      return nullptr;
+    return finish(single, channel, packet_size);
+  }
+
+  message &m = messages[id][channel];
+  if (fragment == 1) {
+    if (m.total)
+      errors_sequence++;                            // previous message never completed
+    m.total = total;
+    m.next = 1;
+    m.bits = 0;
+  } else if (m.total != total || m.next != fragment) {
+    errors_sequence++;
+    m.total = 0;
+    return nullptr;
+  }
+  if (!append(m, payload, chars, fill_bits)) {
+    m.total = 0;
+    return nullptr;
+  }
+  if (fragment < total) {
+    m.next++;
+    return nullptr;
+  }
+  return finish(m, channel, packet_size);
+}
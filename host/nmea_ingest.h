@@ -0,0 +1,92 @@
+/*
+ * Fast reader for the !AIVDM output of aishling/nmea.cpp, the inverse of
+ * nmea_encoder. Sentences are located in the input buffer without copying,
+ * checksums are verified and 6-bit payloads de-armored with SSE2/SSSE3 when
+ * the compiler targets them (e.g. -march=native), with scalar code otherwise.
+ * Multi-sentence messages are reassembled per message id and channel.
+ * Every complete message is delivered in the layout of a firmware FIFO
+ * packet: channel byte, payload bytes, CRC as transmitted on air.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#define NMEA_INGEST_SIMD true
+#else
+#define NMEA_INGEST_SIMD false
+#endif
+
+#define NMEA_MAX_FRAGMENTS   9    // fragment numbers are single digits
+#define NMEA_MAX_PACKET      132  // channel, 1020 payload bits (see AIS_MAX_PACKET_BITS), CRC
+#define NMEA_DEARMOR_SLACK   16   // bytes nmea_dearmor() may write beyond its result
+
+// XOR checksum of size bytes, simd selects the vector code if compiled in
+uint8_t nmea_checksum(const char *data, size_t size, bool simd = NMEA_INGEST_SIMD);
+
+// Converts chars 6-bit characters to bits, first character in the MSBs of
+// out[0]. Writes (chars * 6 + 7) / 8 bytes plus up to NMEA_DEARMOR_SLACK
+// scratch bytes. Returns false if a character is outside the 6-bit alphabet.
+bool nmea_dearmor(const char *text, size_t chars, uint8_t *out, bool simd = NMEA_INGEST_SIMD);
+
+// CRC of an AIS payload as appended by the transmitter (CRC-16/X.25)
+uint16_t nmea_packet_crc(const uint8_t *payload, size_t size);
+
+class nmea_ingest {
+public:
+  // Parses all complete lines in data and calls
+  // on_packet(const uint8_t *packet, size_t size) for every complete message.
+  // Returns the number of bytes consumed; a trailing incomplete line is not
+  // consumed and must be passed again with the following data.
+  template <class F> size_t push(const char *data, size_t size, F &&on_packet);
+
+  void reset();                   // drop partially received messages
+
+  bool simd = NMEA_INGEST_SIMD;   // false forces the scalar code, for comparison
+
+  uint64_t sentences = 0;         // !AIVDM sentences with valid checksum
+  uint64_t packets = 0;           // complete messages delivered
+  uint64_t other = 0;             // other lines, e.g. $PAIS
+  uint64_t errors_checksum = 0;
+  uint64_t errors_format = 0;     // malformed fields or characters
+  uint64_t errors_sequence = 0;   // fragment missing or out of order
+  uint64_t errors_length = 0;     // message longer than NMEA_MAX_PACKET
+
+private:
+  struct message {
+    uint8_t total = 0;            // number of fragments, 0 = idle
+    uint8_t next = 0;             // expected fragment number
+    size_t bits = 0;              // payload bits collected
+    uint8_t data[NMEA_MAX_PACKET + NMEA_DEARMOR_SLACK];   // FIFO packet being assembled
+  };
+
+  const uint8_t *parse(const char *line, size_t length, size_t &packet_size);
+  bool append(message &m, const char *text, size_t chars, uint8_t fill_bits);
+  const uint8_t *finish(message &m, uint8_t channel, size_t &packet_size);
+
+  message messages[10][2];        // multi-sentence messages by id and channel
+  message single;                 // single-sentence messages, the common case
+};
+
+template <class F>
+size_t nmea_ingest::push(const char *data, size_t size, F &&on_packet)
+{
+  size_t position = 0;
+  for (;;) {
+    const char *end = (const char *)memchr(data + position, '\n', size - position);
+    if (!end)
+      return position;
+    size_t length = end - (data + position);
+    if (length && end[-1] == '\r')
+      length--;
+    size_t packet_size;
+    const uint8_t *packet = parse(data + position, length, packet_size);
+    if (packet) {
+      packets++;
+      on_packet(packet, packet_size);
+    }
+    position = end - data + 1;
+  }
+}
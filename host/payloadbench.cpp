@@ -0,0 +1,143 @@
+/*
+ * payloadbench: measures aishling/payload.cpp parsing cost on the host.
+ * Messages are read from !AIVDM sentences (e.g. aisgen --nmea output) and
+ * placed in a 512 byte ring buffer like the firmware FIFO, so fields wrap
+ * around the buffer end the same way.
+ *
+ * usage: payloadbench [-r repeats] sentences.nmea
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#include "../aishling/payload.h"
+
+#define RING_SIZE 512             // same as FIFO_BUFFER_SIZE
+
+struct message {
+  std::vector<uint8_t> payload;   // payload bytes, MSB first
+  uint16_t bits;
+};
+
+// de-armors 6-bit characters and appends the bits to message
+static void append_payload(message &m, const char *text, size_t length, int fill_bits)
+{
+  for (size_t i = 0; i < length; i++) {
+    uint8_t value = text[i] - 48;
+    if (value > 40)
+      value -= 8;
+    for (int b = 5; b >= 0; b--) {
+      if (m.bits % 8 == 0)
+        m.payload.push_back(0);
+      if ((value >> b) & 1)
+        m.payload.back() |= 0x80 >> (m.bits % 8);
+      m.bits++;
+    }
+  }
+  m.bits -= fill_bits;
+}
+
+static std::vector<message> read_messages(FILE *f)
+{
+  std::vector<message> messages;
+  message pending;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    char *field[7];
+    int count = 0;
+    for (char *p = line; count < 7 && p; p = strchr(p, ',')) {
+      if (*p == ',')
+        *p++ = 0;
+      field[count++] = p;
+    }
+    if (count < 7 || strcmp(field[0], "!AIVDM"))
+      continue;
+    int total = atoi(field[1]);
+    int fragment = atoi(field[2]);
+    if (fragment == 1)
+      pending = message();
+    append_payload(pending, field[5], strlen(field[5]), atoi(field[6]));
+    if (fragment == total)
+      messages.push_back(pending);
+  }
+  return messages;
+}
+
+int main(int argc, char **argv)
+{
+  int repeats = 1000;
+  const char *name = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      repeats = atoi(argv[++i]);
+    else
+      name = argv[i];
+  }
+  FILE *f = name ? fopen(name, "r") : nullptr;
+  if (!f) {
+    fprintf(stderr, "usage: payloadbench [-r repeats] sentences.nmea\n");
+    return 1;
+  }
+  std::vector<message> messages = read_messages(f);
+  fclose(f);
+  if (messages.empty()) {
+    fprintf(stderr, "payloadbench: no messages\n");
+    return 1;
+  }
+
+  // lay messages out in rings as in the FIFO, payload after channel byte
+  std::vector<std::vector<uint8_t>> rings(messages.size(), std::vector<uint8_t>(RING_SIZE));
+  std::vector<ais_payload> payloads(messages.size());
+  for (size_t i = 0; i < messages.size(); i++) {
+    uint16_t start = (i * 37) % RING_SIZE;
+    for (size_t b = 0; b < messages[i].payload.size(); b++)
+      rings[i][(start + b) % RING_SIZE] = messages[i].payload[b];
+    payloads[i] = {rings[i].data(), start, RING_SIZE - 1, messages[i].bits};
+  }
+
+  // parse once to check coverage
+  unsigned long types[32] = {0};
+  unsigned long positions = 0, parsed = 0;
+  for (const ais_payload &p : payloads) {
+    ais_report report;
+    if (ais_parse(p, report)) {
+      parsed++;
+      types[report.type & 31]++;
+      positions += (report.flags & AIS_HAS_POSITION) ? 1 : 0;
+    }
+  }
+
+  uint64_t checksum = 0;
+#ifdef HAVE_RDTSC
+  uint64_t cycles_start = __rdtsc();
+#endif
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; r++)
+    for (const ais_payload &p : payloads) {
+      ais_report report;
+      ais_parse(p, report);
+      checksum += report.mmsi + report.lat + report.sog;
+    }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  double total = (double)repeats * payloads.size();
+
+  printf("messages %zu, parsed %lu, with position %lu\n", messages.size(), parsed, positions);
+  for (int t = 0; t < 32; t++)
+    if (types[t])
+      printf("  type %2d: %lu\n", t, types[t]);
+  printf("%.1f ns per message", ns / total);
+#ifdef HAVE_RDTSC
+  printf(", %.0f TSC cycles per message", (__rdtsc() - cycles_start) / total);
+#endif
+  printf(" (checksum %llx)\n", (unsigned long long)checksum);
+  return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * payloadtest: checks aishling/payload.cpp against published reference
+ * sentences of message types 1, 5, 18 and 24 (as used by gpsd and libais).
+ * Every message is checked once at the start of a plain array and once
+ * wrapped around the end of a ring buffer the size of the firmware FIFO.
+ * Exits with 1 if any check fails.
+ *
+ * usage: payloadtest
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "../aishling/payload.h"
+
+#define RING_SIZE 512             // same as FIFO_BUFFER_SIZE
+
+static int checks, failures;
+
+#define CHECK_EQ(actual, expected) check_eq(#actual, (long long)(actual), (long long)(expected), __LINE__)
+
+static void check_eq(const char *what, long long actual, long long expected, int line)
+{
+  checks++;
+  if (actual == expected)
+    return;
+  failures++;
+  fprintf(stderr, "payloadtest.cpp:%d: %s is %lld, expected %lld\n", line, what, actual, expected);
+}
+
+static void check_text(const ais_payload &p, const ais_field &field, uint8_t chars, const char *expected, int line)
+{
+  std::string text;
+  for (uint8_t i = 0; i < chars; i++)
+    text += ais_get_char(p, field, i);
+  text.erase(text.find_last_not_of("@ ") + 1);    // '@' and ' ' pad text fields
+  checks++;
+  if (text == expected)
+    return;
+  failures++;
+  fprintf(stderr, "payloadtest.cpp:%d: text is \"%s\", expected \"%s\"\n", line, text.c_str(), expected);
+}
+
+#define CHECK_TEXT(p, field, chars, expected) check_text(p, field, chars, expected, __LINE__)
+
+// payload of one message, from the 6-bit payload fields of its sentences
+struct message {
+  std::vector<uint8_t> bytes;
+  uint16_t bits = 0;
+};
+
+static message dearmor(const char *text, int fill_bits)
+{
+  message m;
+  for (const char *c = text; *c; c++) {
+    uint8_t value = *c - 48;
+    if (value > 40)
+      value -= 8;
+    for (int b = 5; b >= 0; b--) {
+      if (m.bits % 8 == 0)
+        m.bytes.push_back(0);
+      if ((value >> b) & 1)
+        m.bytes.back() |= 0x80 >> (m.bits % 8);
+      m.bits++;
+    }
+  }
+  m.bits -= fill_bits;
+  return m;
+}
+
+// plain array and ring buffer layout of the same message
+struct layouts {
+  std::vector<uint8_t> ring = std::vector<uint8_t>(RING_SIZE, 0xa5);
+  ais_payload payload[2];
+
+  explicit layouts(const message &m)
+  {
+    uint16_t start = RING_SIZE - m.bytes.size() / 2;   // wraps in the middle of the message
+    for (size_t i = 0; i < m.bytes.size(); i++)
+      ring[(start + i) % RING_SIZE] = m.bytes[i];
+    payload[0] = {m.bytes.data(), 0, 0xffff, m.bits};
+    payload[1] = {ring.data(), start, RING_SIZE - 1, m.bits};
+  }
+};
+
+// !AIVDM,1,1,,A,15RTgt0PAso;90TKcjM8h6g208CQ,0*4A
+static void test_type_1(void)
+{
+  message m = dearmor("15RTgt0PAso;90TKcjM8h6g208CQ", 0);
+  layouts l(m);
+  for (const ais_payload &p : l.payload) {
+    ais_report r;
+    CHECK_EQ(ais_parse(p, r), true);
+    CHECK_EQ(r.type, 1);
+    CHECK_EQ(r.mmsi, 371798000);
+    CHECK_EQ(r.flags, AIS_HAS_POSITION | AIS_HAS_MOTION | AIS_HAS_SECOND);
+    CHECK_EQ(r.lat, 29028980);                    // 48.381633 N
+    CHECK_EQ(r.lon, -74037230);                   // 123.395383 W
+    CHECK_EQ(r.sog, 123);
+    CHECK_EQ(r.cog, 2240);
+    CHECK_EQ(r.second, 33);
+    CHECK_EQ(ais_get(p, AIS_1_STATUS), 0);
+    CHECK_EQ(ais_get(p, AIS_1_HEADING), 215);
+  }
+}
+
+// !AIVDM,2,1,1,A,55?MbV02;H;s<HtKR20EHE:0@T4@Dn2222222216L961O5Gf0NSQEp6ClRp8,0*1C
+// !AIVDM,2,2,1,A,88888888880,2*25
+static void test_type_5(void)
+{
+  message m = dearmor("55?MbV02;H;s<HtKR20EHE:0@T4@Dn2222222216L961O5Gf0NSQEp6ClRp8"
+                      "88888888880", 2);
+  CHECK_EQ(m.bits, 424);
+  layouts l(m);
+  for (const ais_payload &p : l.payload) {
+    ais_report r;
+    CHECK_EQ(ais_parse(p, r), true);
+    CHECK_EQ(r.type, 5);
+    CHECK_EQ(r.mmsi, 351759000);
+    CHECK_EQ(r.flags, AIS_HAS_STATIC);
+    CHECK_EQ(r.lat, AIS_LAT_NA);
+    CHECK_EQ(ais_get(p, AIS_5_IMO), 9134270);
+    CHECK_TEXT(p, AIS_5_CALLSIGN, 7, "3FOF8");
+    CHECK_TEXT(p, AIS_5_NAME, 20, "EVER DIADEM");
+    CHECK_EQ(ais_get(p, AIS_5_SHIP_TYPE), 70);
+    CHECK_EQ(ais_get(p, AIS_5_DRAUGHT), 122);
+    CHECK_TEXT(p, AIS_5_DESTINATION, 20, "NEW YORK");
+  }
+}
+
+// !AIVDM,1,1,,A,B6CdCm0t3`tba35f@V9faHi7kP06,0*58
+static void test_type_18(void)
+{
+  message m = dearmor("B6CdCm0t3`tba35f@V9faHi7kP06", 0);
+  layouts l(m);
+  for (const ais_payload &p : l.payload) {
+    ais_report r;
+    CHECK_EQ(ais_parse(p, r), true);
+    CHECK_EQ(r.type, 18);
+    CHECK_EQ(r.mmsi, 423302100);
+    CHECK_EQ(r.flags, AIS_HAS_POSITION | AIS_HAS_MOTION | AIS_HAS_SECOND);
+    CHECK_EQ(r.lat, 24003170);                    // 40.005283 N
+    CHECK_EQ(r.lon, 31806598);                    // 53.010997 E
+    CHECK_EQ(r.sog, 14);
+    CHECK_EQ(r.cog, 1770);
+    CHECK_EQ(r.second, 34);
+    CHECK_EQ(ais_get(p, AIS_18_HEADING), 177);
+  }
+}
+
+// !AIVDM,1,1,,A,H42O55i18tMET00000000000000,2*6D
+// !AIVDM,1,1,,A,H42O55lti4hhhilD3nink000?050,0*40
+static void test_type_24(void)
+{
+  message a = dearmor("H42O55i18tMET00000000000000", 2);
+  layouts la(a);
+  for (const ais_payload &p : la.payload) {
+    ais_report r;
+    CHECK_EQ(ais_parse(p, r), true);
+    CHECK_EQ(r.type, 24);
+    CHECK_EQ(r.mmsi, 271041815);
+    CHECK_EQ(r.flags, AIS_HAS_STATIC);
+    CHECK_EQ(ais_get(p, AIS_24_PART), 0);
+    CHECK_TEXT(p, AIS_24_NAME, 20, "PROGUY");
+  }
+
+  message b = dearmor("H42O55lti4hhhilD3nink000?050", 0);
+  layouts lb(b);
+  for (const ais_payload &p : lb.payload) {
+    ais_report r;
+    CHECK_EQ(ais_parse(p, r), true);
+    CHECK_EQ(r.mmsi, 271041815);
+    CHECK_EQ(ais_get(p, AIS_24_PART), 1);
+    CHECK_EQ(ais_get(p, AIS_24_SHIP_TYPE), 60);
+    CHECK_TEXT(p, AIS_24_CALLSIGN, 7, "TC6163");
+  }
+}
+
+// fields beyond the received bits read as 0, short messages are rejected
+static void test_truncated(void)
+{
+  message m = dearmor("15RTgt0PAso;90TKcjM8h6g208CQ", 0);
+  ais_payload p = {m.bytes.data(), 0, 0xffff, 100};   // ends within latitude
+  ais_report r;
+  CHECK_EQ(ais_parse(p, r), true);
+  CHECK_EQ(r.mmsi, 371798000);
+  CHECK_EQ(r.flags, 0);
+  CHECK_EQ(ais_has(p, AIS_1_LAT), false);
+  CHECK_EQ(ais_get(p, AIS_1_LAT), 0);
+
+  p.bits = 37;                                      // MMSI incomplete
+  CHECK_EQ(ais_parse(p, r), false);
+}
+
+int main()
+{
+  test_type_1();
+  test_type_5();
+  test_type_18();
+  test_type_24();
+  test_truncated();
+  fprintf(stderr, "payloadtest: %d checks, %d failed\n", checks, failures);
+  return failures ? 1 : 0;
+}
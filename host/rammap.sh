@@ -0,0 +1,63 @@
+#!/bin/sh
+# RAM map of the firmware: static RAM per module and what is left for the stack.
+#
+#   rammap.sh <build path>
+#
+# <build path> is the directory given to arduino-cli compile --build-path.
+# Symbols in the linked .elf are attributed to the object (sketch module or
+# core library member) that defines them; RAM not covered by any named
+# symbol, mostly string literals that live in .data, is listed as unnamed.
+# Set NM, SIZE and RAM to use other tools or another chip.
+
+NM=${NM:-avr-nm}
+SIZE=${SIZE:-avr-size}
+RAM=${RAM:-2560}                    # ATmega32u4
+
+build=$1
+if [ -z "$build" ] || [ ! -d "$build" ]; then
+  echo "usage: $0 <build path>" >&2
+  exit 2
+fi
+elf=$(ls "$build"/*.elf 2>/dev/null | head -n 1)
+if [ -z "$elf" ]; then
+  echo "$0: no .elf in $build" >&2
+  exit 1
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# RAM symbols of the linked firmware: name size
+$NM -S -t d --defined-only "$elf" | awk 'NF == 4 && $3 ~ /^[bBdD]$/ { print $4, $2 + 0 }' \
+  | sort -u > "$tmp/elf"
+
+# module name for each RAM symbol defined in an object
+for obj in "$build"/sketch/*.o "$build"/core/*.a; do
+  [ -f "$obj" ] || continue
+  $NM -S --defined-only "$obj" 2>/dev/null | awk -v obj="$(basename "$obj")" '
+    /:$/ { member = substr($0, 1, length($0) - 1); next }   # archive member
+    NF == 4 && $3 ~ /^[bBdD]$/ {
+      name = member != "" ? member : obj
+      sub(/\.(cpp|c|S)\.o$/, "", name); sub(/\.o$/, "", name)
+      print $4, name
+    }'
+done | sort -u > "$tmp/owner"
+
+# data and bss as linked
+$SIZE -A "$elf" | awk '$1 == ".data" || $1 == ".bss" || $1 == ".noinit" { total += $2 } END { print total + 0 }' > "$tmp/total"
+
+awk -v ram="$RAM" -v total="$(cat "$tmp/total")" '
+  FNR == NR { owner[$1] = $2; next }
+  {
+    module = ($1 in owner) ? owner[$1] : "(unknown)"
+    bytes[module] += $2
+    named += $2
+  }
+  END {
+    for (m in bytes)
+      printf "%6d  %s\n", bytes[m], m | "sort -rn"
+    close("sort -rn")
+    if (total > named)
+      printf "%6d  %s\n", total - named, "(unnamed, string literals and padding)"
+    printf "------\n%6d  static RAM\n%6d  left for stack of %d\n", total, ram - total, ram
+  }' "$tmp/owner" "$tmp/elf"
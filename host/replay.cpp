@@ -0,0 +1,286 @@
+/*
+ * replay: feeds a capture stream into the unmodified firmware decoder
+ * (aishling/ais.cpp, fifo.cpp, nmea.cpp) running on the host HAL. The
+ * simulated receiver hops channels exactly like the device, so only bits of
+ * the currently tuned channel reach ais_interrupt(). loop() is modelled as a
+ * task running every --loop-us microseconds, NMEA output is throttled to
+ * --baud to find out when the output falls behind.
+ *
+ * usage: replay [options] traffic.cap
+ *   --nmea FILE      expected sentences (from aisgen) to compute the receive ratio
+ *   --loop-us N      interval between loop() runs (default 100)
+ *   --baud N         output rate in bit/s, 0 = unlimited (default 0)
+ *   --isr-budget N   ISR budget in ns, calls exceeding it are counted (default 0 = off)
+ *   --packet-handler search the sync word and hop like the Si4463 in packet handler
+ *                    mode (see aishling/rxfifo.cpp), decode only the bytes after it
+ *   --radio-events   model the radio's preamble detection and timeout interrupts
+ *                    (see aishling/rxevent.cpp)
+ *   -v               print decoded sentences
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "capture_stream.h"
+#include "../aishling/ais.h"
+#include "../aishling/fifo.h"
+#include "../aishling/nmea.h"
+#include "../aishling/radio.h"
+
+#define AIS_BIT_RATE 9600
+
+extern volatile uint8_t ph_radio_channel;
+
+// radio stubs, the decoder only hops channels
+static uint8_t tuned_channel;
+static unsigned long hops;
+static uint8_t sync_window;                 // packet handler mode: last 8 raw bits
+static uint16_t preamble_window;            // radio events: last 16 raw bits
+static size_t preamble_timeout;             // radio events: bits left until preamble timeout
+static unsigned long preamble_events, early_hops;
+
+void rxevent_sync(void)
+{
+}
+
+// latency tracing is firmware only
+void latency_encoded(void)
+{
+}
+
+void latency_written(void)
+{
+}
+
+void radio_rx(uint8_t channel)
+{
+  tuned_channel = channel;
+  hops++;
+  sync_window = 0;
+  preamble_window = 0;
+  preamble_timeout = 12;                    // RX_PREAMBLE_TIMEOUT of radio.cpp
+}
+
+
+static bool read_file(const char *name, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return false;
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(f);
+  return true;
+}
+
+// returns payload field of every !AIVDM sentence in text
+static std::multiset<std::string> payloads(const std::string &text)
+{
+  std::multiset<std::string> result;
+  size_t start = 0;
+  while (start < text.size()) {
+    size_t end = text.find('\n', start);
+    if (end == std::string::npos)
+      end = text.size();
+    std::string line = text.substr(start, end - start);
+    start = end + 1;
+    if (line.compare(0, 7, "!AIVDM,"))
+      continue;
+    size_t field = 0;
+    for (int i = 0; i < 5 && field != std::string::npos; i++)
+      field = line.find(',', field + 1);
+    if (field == std::string::npos)
+      continue;
+    result.insert(line.substr(field + 1, line.find(',', field + 1) - field - 1));
+  }
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  const char *capture_name = nullptr;
+  const char *nmea_name = nullptr;
+  uint32_t loop_us = 100;
+  uint32_t baud = 0;
+  uint64_t isr_budget = 0;
+  bool verbose = false;
+  bool packet_handler = false;
+  bool radio_events = false;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--nmea") && i + 1 < argc)
+      nmea_name = argv[++i];
+    else if (!strcmp(argv[i], "--loop-us") && i + 1 < argc)
+      loop_us = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--baud") && i + 1 < argc)
+      baud = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--isr-budget") && i + 1 < argc)
+      isr_budget = atoll(argv[++i]);
+    else if (!strcmp(argv[i], "--packet-handler"))
+      packet_handler = true;
+    else if (!strcmp(argv[i], "--radio-events"))
+      radio_events = true;
+    else if (!strcmp(argv[i], "-v"))
+      verbose = true;
+    else
+      capture_name = argv[i];
+  }
+  if (!capture_name) {
+    fprintf(stderr, "usage: replay [--nmea FILE] [--loop-us N] [--baud N] [--isr-budget NS] [--packet-handler] [--radio-events] [-v] traffic.cap\n");
+    return 1;
+  }
+
+  // rebuild both channels on a common time base
+  std::vector<uint8_t> input;
+  if (!read_file(capture_name, input)) {
+    fprintf(stderr, "replay: cannot read %s\n", capture_name);
+    return 1;
+  }
+  std::vector<uint8_t> levels[2];
+  capture_parser parser;
+  bool have_start = false;
+  uint32_t start_us = 0;
+  parser.push(input.data(), input.size(), [&](const capture_frame &frame) {
+    if (!have_start) {
+      start_us = frame.timestamp;
+      have_start = true;
+    }
+    size_t position = (uint64_t)(uint32_t)(frame.timestamp - start_us) * AIS_BIT_RATE / 1000000;
+    std::vector<uint8_t> &ch = levels[frame.channel];
+    if (ch.size() < position + frame.size * 8)
+      ch.resize(position + frame.size * 8);
+    for (size_t i = 0; i < frame.size * 8u; i++)
+      ch[position + i] = (frame.data[i / 8] >> (i % 8)) & 1;
+  });
+  size_t total_bits = std::max(levels[0].size(), levels[1].size());
+  levels[0].resize(total_bits);
+  levels[1].resize(total_bits);
+
+  // run firmware
+  ais_setup();
+  tuned_channel = ph_radio_channel;
+  uint64_t isr_ns = 0, isr_max_ns = 0, isr_over = 0, isr_calls = 0;
+  uint8_t shift_register = 0;
+  uint8_t shift_count = 0;
+  size_t last_hop_bit = 0;
+  if (packet_handler)
+    ais_hop();
+  uint64_t uart_busy_until = 0;               // time when UART has sent everything
+  uint64_t max_backlog_us = 0;
+  uint32_t next_loop = 0;
+  size_t max_packets = 0;
+  std::string output;
+
+  for (size_t bit = 0; bit < total_bits; bit++) {
+    uint64_t now = (uint64_t)bit * 1000000 / AIS_BIT_RATE;
+    hal_micros = (uint32_t)now;
+    hal_pins[radio_data] = levels[tuned_channel][bit];
+
+    shift_register = shift_register >> 1 | hal_pins[radio_data] << 7;
+    bool call = true;
+    if (radio_events) {
+      // 16 bit non-standard preamble pattern, timeout after 16 bits without it
+      preamble_window = preamble_window >> 1 | hal_pins[radio_data] << 15;
+      if (preamble_window == 0x6666) {
+        preamble_events++;
+        ais_preamble();
+        preamble_timeout = 0;
+      } else if (preamble_timeout && !--preamble_timeout) {
+        early_hops += ais_skip_channel();
+      }
+    }
+    if (packet_handler) {
+      // radio searches sync and fills the FIFO, the decoder sees whole bytes after sync
+      sync_window = sync_window >> 1 | hal_pins[radio_data] << 7;
+      call = false;
+      if (ais_receiving()) {
+        call = ++shift_count == 8;
+        shift_count &= 7;
+      } else if (sync_window == 0x66) {      // sync word of radio.cpp
+        ais_sync(tuned_channel);
+        shift_count = 0;
+      } else if (bit - last_hop_bit > 16) {  // RSSI timeout of the radio's RX hop, no RSSI in captures
+        tuned_channel ^= 1;                 // radio hops by itself, the decoder is not involved
+        hops++;
+        last_hop_bit = bit;
+      }
+    }
+    if (call) {
+      auto begin = std::chrono::steady_clock::now();
+      if (packet_handler)
+        ais_process_byte(shift_register);
+      else
+        ais_interrupt();
+      uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+      isr_ns += ns;
+      isr_max_ns = std::max(isr_max_ns, ns);
+      if (isr_budget && ns > isr_budget)
+        isr_over++;
+      isr_calls++;
+      if (packet_handler && !ais_receiving())
+        last_hop_bit = bit;
+    }
+
+    if (now < next_loop)
+      continue;
+    next_loop = (uint32_t)now + loop_us;
+
+    // loop(): count waiting packets, then send one if UART has room
+    size_t waiting = fifo_packet_count();
+    max_packets = std::max(max_packets, waiting);
+    if (uart_busy_until > now) {
+      max_backlog_us = std::max(max_backlog_us, uart_busy_until - now);
+      continue;
+    }
+    if (fifo_get_packet()) {
+      Serial.output.clear();
+      nmea_process_packet();
+      fifo_remove_packet();
+      if (baud)
+        uart_busy_until = now + (uint64_t)Serial.output.size() * 10 * 1000000 / baud;
+      output += Serial.output;
+    }
+  }
+
+  if (verbose)
+    fwrite(output.data(), 1, output.size(), stdout);
+
+  std::multiset<std::string> received = payloads(output);
+  double seconds = (double)total_bits / AIS_BIT_RATE;
+  fprintf(stderr, "%.1f s replayed, %zu sentences (%.0f/min), %lu channel hops\n",
+          seconds, received.size(), received.size() * 60 / seconds, hops);
+  if (radio_events)
+    fprintf(stderr, "%lu preamble events, %lu early hops\n", preamble_events, early_hops);
+  fprintf(stderr, "FIFO overflows %u, max packets waiting %zu, max output backlog %.1f ms\n",
+          fifo_overflow_count(), max_packets, max_backlog_us / 1000.0);
+  fprintf(stderr, "%s host time: %llu calls, mean %.0f ns, max %llu ns",
+          packet_handler ? "ais_process_byte()" : "ais_interrupt()", (unsigned long long)isr_calls,
+          isr_calls ? (double)isr_ns / isr_calls : 0.0, (unsigned long long)isr_max_ns);
+  if (isr_budget)
+    fprintf(stderr, ", %llu calls over budget", (unsigned long long)isr_over);
+  fprintf(stderr, "\n");
+
+  if (nmea_name) {
+    std::vector<uint8_t> nmea;
+    if (!read_file(nmea_name, nmea)) {
+      fprintf(stderr, "replay: cannot read %s\n", nmea_name);
+      return 1;
+    }
+    std::multiset<std::string> expected = payloads(std::string(nmea.begin(), nmea.end()));
+    size_t matched = 0;
+    for (const std::string &p : expected)
+      matched += received.count(p) ? 1 : 0;
+    fprintf(stderr, "expected %zu sentences, received %zu (%.1f%%)\n", expected.size(), matched,
+            expected.empty() ? 0.0 : 100.0 * matched / expected.size());
+  }
+  return 0;
+}
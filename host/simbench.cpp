@@ -0,0 +1,426 @@
+/*
+ * simbench: runs the firmware ELF, built with -DAIS_BENCH, on simavr and
+ * counts AVR cycles of the instrumented sections (see aishling/bench.h).
+ * The radio clock (D2/PD1) and data (D3/PD0) pins are driven at 9600 bit/s
+ * from a capture stream, following the channel hops the firmware sends over
+ * SPI. The Si4463 is simulated as always ready and receiving: it answers
+ * REQUEST_DEVICE_STATE with RX and GET_CHIP_STATUS with nothing pending, so
+ * the health monitor (aishling/health.cpp) sees a working radio; every other
+ * SPI byte reads 0xff.
+ *
+ * Section times include nested sections, but not the time spent in
+ * ais_interrupt() while a main loop section was interrupted. Interrupt entry
+ * and exit (vector, register saves, attachInterrupt dispatch) are outside
+ * the markers and not counted.
+ *
+ * Results are written as one JSON object per section and line. With
+ * --baseline, mean and max are compared against an earlier result and the
+ * exit code is 1 if a section got slower than --tolerance percent.
+ *
+ * usage: simbench [options] firmware.elf traffic.cap
+ *   --baseline FILE  earlier output to compare against
+ *   --tolerance N    allowed increase in percent (default 2)
+ *   --drain-ms N     run time after the last bit (default 100)
+ *   -o FILE          write results to FILE instead of stdout
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_irq.h"
+#include "sim_cycle_timers.h"
+#include "avr_ioport.h"
+#include "avr_spi.h"
+
+#include "capture_stream.h"
+#include "../aishling/bench.h"
+
+#define AIS_BIT_RATE   9600
+#define CPU_FREQUENCY  8000000
+#define GPIOR0_ADDRESS 0x3e           // data space address of GPIOR0
+#define NSEL_PIN       6              // D10 = PB6, Si4463 chip select
+#define DATA_PIN       0              // D3 = PD0
+#define CLOCK_PIN      1              // D2 = PD1
+#define CMD_START_RX   0x32
+#define CMD_GET_CHIP_STATUS      0x23
+#define CMD_REQUEST_DEVICE_STATE 0x33
+#define CMD_READ_CMD_BUFF        0x44
+#define RADIO_STATE_RX 8
+#define BIT_BUDGET     (CPU_FREQUENCY / AIS_BIT_RATE)   // cycles between two clock edges
+
+struct section_stats {
+  uint64_t calls = 0;
+  uint64_t total = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+  uint64_t over_budget = 0;
+};
+
+struct open_section {
+  uint8_t id;
+  avr_cycle_count_t start;
+  avr_cycle_count_t interrupted;      // cycles spent in ais_interrupt() meanwhile
+};
+
+struct bench {
+  avr_t *avr;
+  avr_irq_t *data_pin;
+  avr_irq_t *clock_pin;
+  avr_irq_t *spi_in;
+
+  std::vector<uint8_t> levels[2];     // line level per bit time and channel
+  size_t bit = 0;
+  avr_cycle_count_t first_edge = 0;
+  bool running = false;
+  bool done = false;
+
+  uint8_t tuned_channel = 0;
+  bool selected = false;
+  uint8_t spi_index = 0;
+  uint8_t spi_command = 0;
+  uint8_t last_command = 0;           // command whose response READ_CMD_BUFF returns
+  uint64_t hops = 0;
+
+  std::vector<open_section> stack;
+  std::map<uint8_t, section_stats> stats;
+};
+
+static const char *section_name(uint8_t id)
+{
+  switch (id) {
+  case BENCH_AIS_OFF:             return "ais_interrupt.off";
+  case BENCH_AIS_RESET:           return "ais_interrupt.reset";
+  case BENCH_AIS_WAIT_FOR_SYNC:   return "ais_interrupt.wait_for_sync";
+  case BENCH_AIS_PREFETCH:        return "ais_interrupt.prefetch";
+  case BENCH_AIS_RECEIVE_PACKET:  return "ais_interrupt.receive_packet";
+  case BENCH_AIS_BYTE:            return "ais_process_byte";
+  case BENCH_NMEA_PACKET:         return "nmea_process_packet";
+  case BENCH_NMEA_SENTENCE:       return "nmea_process_packet.sentence";
+  case BENCH_FIFO_NEW_PACKET:     return "fifo_new_packet";
+  case BENCH_FIFO_WRITE_BYTE:     return "fifo_write_byte";
+  case BENCH_FIFO_COMMIT_PACKET:  return "fifo_commit_packet";
+  case BENCH_FIFO_GET_PACKET:     return "fifo_get_packet";
+  case BENCH_FIFO_READ_BYTE:      return "fifo_read_byte";
+  case BENCH_FIFO_REMOVE_PACKET:  return "fifo_remove_packet";
+  case BENCH_RADIO_RX:            return "radio_rx";
+  }
+  return nullptr;
+}
+
+static bool is_interrupt(uint8_t id)
+{
+  return id >= BENCH_AIS_OFF && id <= BENCH_AIS_BYTE;
+}
+
+static avr_cycle_count_t clock_edge(avr_t *avr, avr_cycle_count_t when, void *param);
+
+// GPIOR0 written by BENCH_ENTER()/BENCH_EXIT()
+static void marker_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  bench *b = (bench *)param;
+  avr->data[addr] = v;
+  if (v == BENCH_READY) {
+    if (!b->running) {
+      b->running = true;
+      b->first_edge = avr->cycle + BIT_BUDGET;
+      avr_cycle_timer_register(avr, BIT_BUDGET, clock_edge, b);
+    }
+    return;
+  }
+  if (v != BENCH_LEAVE) {
+    b->stack.push_back({v, avr->cycle, 0});
+    return;
+  }
+  if (b->stack.empty()) {
+    fprintf(stderr, "simbench: unbalanced marker at cycle %llu\n", (unsigned long long)avr->cycle);
+    return;
+  }
+  open_section s = b->stack.back();
+  b->stack.pop_back();
+  uint64_t cycles = avr->cycle - s.start;
+  if (is_interrupt(s.id)) {
+    for (open_section &outer : b->stack)
+      if (!is_interrupt(outer.id))
+        outer.interrupted += cycles;
+  } else {
+    cycles -= s.interrupted;
+  }
+  section_stats &st = b->stats[s.id];
+  st.calls++;
+  st.total += cycles;
+  st.min = std::min(st.min, cycles);
+  st.max = std::max(st.max, cycles);
+  if (cycles > BIT_BUDGET)
+    st.over_budget++;
+}
+
+// follows CMD_START_RX to know the channel the firmware listens to
+static void nsel_changed(avr_irq_t *irq, uint32_t value, void *param)
+{
+  bench *b = (bench *)param;
+  b->selected = !value;
+  b->spi_index = 0;
+}
+
+// reply to the byte at position index of a transaction that started with command
+static uint8_t radio_reply(bench *b, uint8_t command, uint8_t index)
+{
+  if (command != CMD_READ_CMD_BUFF || index < 2)
+    return 0xff;                      // CTS ready
+  uint8_t response = index - 2;       // READ_CMD_BUFF, CTS, then response bytes
+  switch (b->last_command) {
+  case CMD_REQUEST_DEVICE_STATE:
+    return response == 0 ? RADIO_STATE_RX : response == 1 ? b->tuned_channel : 0xff;
+  case CMD_GET_CHIP_STATUS:
+    return 0;                         // no chip interrupts or errors pending
+  }
+  return 0xff;
+}
+
+static void spi_byte(avr_irq_t *irq, uint32_t value, void *param)
+{
+  bench *b = (bench *)param;
+  uint8_t reply = 0xff;
+  if (b->selected) {
+    if (b->spi_index == 0) {
+      b->spi_command = value;
+      if (value != CMD_READ_CMD_BUFF)
+        b->last_command = value;
+    } else if (b->spi_index == 1 && b->spi_command == CMD_START_RX) {
+      b->tuned_channel = value & 1;
+      b->hops++;
+    }
+    reply = radio_reply(b, b->spi_command, b->spi_index);
+    b->spi_index++;
+  }
+  avr_raise_irq(b->spi_in, reply);
+}
+
+// rising edge at every bit time with data valid, falling edge half a bit later
+static avr_cycle_count_t clock_edge(avr_t *avr, avr_cycle_count_t when, void *param)
+{
+  bench *b = (bench *)param;
+  if (b->clock_pin->value) {
+    avr_raise_irq(b->clock_pin, 0);
+    b->bit++;
+    return b->first_edge + (avr_cycle_count_t)b->bit * CPU_FREQUENCY / AIS_BIT_RATE;
+  }
+  if (b->bit >= b->levels[0].size()) {
+    b->done = true;
+    return 0;
+  }
+  avr_raise_irq(b->data_pin, b->levels[b->tuned_channel][b->bit]);
+  avr_raise_irq(b->clock_pin, 1);
+  return when + BIT_BUDGET / 2;
+}
+
+static bool read_file(const char *name, std::vector<uint8_t> &data)
+{
+  FILE *f = fopen(name, "rb");
+  if (!f)
+    return false;
+  uint8_t buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  fclose(f);
+  return true;
+}
+
+// returns the value of "key": in a line written by print_results()
+static bool json_number(const std::string &line, const char *key, double &value)
+{
+  std::string pattern = std::string("\"") + key + "\":";
+  size_t pos = line.find(pattern);
+  if (pos == std::string::npos)
+    return false;
+  value = strtod(line.c_str() + pos + pattern.size(), nullptr);
+  return true;
+}
+
+static bool json_string(const std::string &line, const char *key, std::string &value)
+{
+  std::string pattern = std::string("\"") + key + "\":\"";
+  size_t pos = line.find(pattern);
+  if (pos == std::string::npos)
+    return false;
+  pos += pattern.size();
+  value = line.substr(pos, line.find('"', pos) - pos);
+  return true;
+}
+
+static void print_results(FILE *out, const bench &b, double seconds)
+{
+  for (const auto &entry : b.stats) {
+    const char *name = section_name(entry.first);
+    const section_stats &st = entry.second;
+    if (!name || !st.calls)
+      continue;
+    fprintf(out, "{\"section\":\"%s\",\"calls\":%llu,\"min\":%llu,\"mean\":%.1f,\"max\":%llu,"
+            "\"over_budget\":%llu}\n", name, (unsigned long long)st.calls,
+            (unsigned long long)st.min, (double)st.total / st.calls,
+            (unsigned long long)st.max, (unsigned long long)st.over_budget);
+  }
+  fprintf(out, "{\"section\":\"run\",\"seconds\":%.3f,\"bits\":%zu,\"hops\":%llu,\"budget\":%d}\n",
+          seconds, b.bit, (unsigned long long)b.hops, BIT_BUDGET);
+}
+
+// compares mean and max per section, returns number of regressions
+static int compare_baseline(const char *name, const bench &b, double tolerance)
+{
+  std::vector<uint8_t> text;
+  if (!read_file(name, text)) {
+    fprintf(stderr, "simbench: cannot read %s\n", name);
+    return 1;
+  }
+  std::map<std::string, const section_stats *> current;
+  for (const auto &entry : b.stats)
+    if (section_name(entry.first))
+      current[section_name(entry.first)] = &entry.second;
+
+  int regressions = 0;
+  std::string all(text.begin(), text.end());
+  size_t start = 0;
+  while (start < all.size()) {
+    size_t end = all.find('\n', start);
+    if (end == std::string::npos)
+      end = all.size();
+    std::string line = all.substr(start, end - start);
+    start = end + 1;
+
+    std::string section;
+    double mean, max;
+    if (!json_string(line, "section", section) || !json_number(line, "mean", mean) ||
+        !json_number(line, "max", max))
+      continue;
+    auto it = current.find(section);
+    if (it == current.end())
+      continue;
+    double new_mean = (double)it->second->total / it->second->calls;
+    double new_max = (double)it->second->max;
+    bool slower = new_mean > mean * (1 + tolerance / 100) || new_max > max * (1 + tolerance / 100);
+    if (slower)
+      regressions++;
+    fprintf(stderr, "%-32s mean %8.1f -> %8.1f  max %6.0f -> %6.0f%s\n", section.c_str(),
+            mean, new_mean, max, new_max, slower ? "  REGRESSION" : "");
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv)
+{
+  const char *elf_name = nullptr;
+  const char *capture_name = nullptr;
+  const char *baseline_name = nullptr;
+  const char *output_name = nullptr;
+  double tolerance = 2;
+  uint32_t drain_ms = 100;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--baseline") && i + 1 < argc)
+      baseline_name = argv[++i];
+    else if (!strcmp(argv[i], "--tolerance") && i + 1 < argc)
+      tolerance = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--drain-ms") && i + 1 < argc)
+      drain_ms = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+      output_name = argv[++i];
+    else if (!elf_name)
+      elf_name = argv[i];
+    else
+      capture_name = argv[i];
+  }
+  if (!elf_name || !capture_name) {
+    fprintf(stderr, "usage: simbench [--baseline FILE] [--tolerance N] [--drain-ms N] [-o FILE] "
+            "firmware.elf traffic.cap\n");
+    return 1;
+  }
+
+  // rebuild both channels on a common time base, as replay does
+  std::vector<uint8_t> input;
+  if (!read_file(capture_name, input)) {
+    fprintf(stderr, "simbench: cannot read %s\n", capture_name);
+    return 1;
+  }
+  bench b;
+  capture_parser parser;
+  bool have_start = false;
+  uint32_t start_us = 0;
+  parser.push(input.data(), input.size(), [&](const capture_frame &frame) {
+    if (!have_start) {
+      start_us = frame.timestamp;
+      have_start = true;
+    }
+    size_t position = (uint64_t)(uint32_t)(frame.timestamp - start_us) * AIS_BIT_RATE / 1000000;
+    std::vector<uint8_t> &ch = b.levels[frame.channel];
+    if (ch.size() < position + frame.size * 8)
+      ch.resize(position + frame.size * 8);
+    for (size_t i = 0; i < frame.size * 8u; i++)
+      ch[position + i] = (frame.data[i / 8] >> (i % 8)) & 1;
+  });
+  size_t total_bits = std::max(b.levels[0].size(), b.levels[1].size());
+  b.levels[0].resize(total_bits);
+  b.levels[1].resize(total_bits);
+
+  // set up simulated MCU
+  elf_firmware_t firmware = {};
+  if (elf_read_firmware(elf_name, &firmware)) {
+    fprintf(stderr, "simbench: cannot load %s\n", elf_name);
+    return 1;
+  }
+  strcpy(firmware.mmcu, "atmega32u4");
+  firmware.frequency = CPU_FREQUENCY;
+  b.avr = avr_make_mcu_by_name(firmware.mmcu);
+  if (!b.avr) {
+    fprintf(stderr, "simbench: simavr lacks atmega32u4 support\n");
+    return 1;
+  }
+  avr_init(b.avr);
+  avr_load_firmware(b.avr, &firmware);
+
+  avr_register_io_write(b.avr, GPIOR0_ADDRESS, marker_write, &b);
+  b.data_pin = avr_io_getirq(b.avr, AVR_IOCTL_IOPORT_GETIRQ('D'), DATA_PIN);
+  b.clock_pin = avr_io_getirq(b.avr, AVR_IOCTL_IOPORT_GETIRQ('D'), CLOCK_PIN);
+  b.spi_in = avr_io_getirq(b.avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(b.avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), spi_byte, &b);
+  avr_irq_register_notify(avr_io_getirq(b.avr, AVR_IOCTL_IOPORT_GETIRQ('B'), NSEL_PIN), nsel_changed, &b);
+
+  // run until all bits are clocked in and loop() had time to send the rest
+  avr_cycle_count_t stop = 0;
+  int state = cpu_Running;
+  while (state != cpu_Done && state != cpu_Crashed) {
+    state = avr_run(b.avr);
+    if (b.done && !stop)
+      stop = b.avr->cycle + (avr_cycle_count_t)drain_ms * (CPU_FREQUENCY / 1000);
+    if (stop && b.avr->cycle >= stop)
+      break;
+  }
+  if (state == cpu_Crashed) {
+    fprintf(stderr, "simbench: firmware crashed at cycle %llu\n", (unsigned long long)b.avr->cycle);
+    return 1;
+  }
+  if (!b.running) {
+    fprintf(stderr, "simbench: no BENCH_READY mark, firmware not built with -DAIS_BENCH?\n");
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if (output_name && !(out = fopen(output_name, "w"))) {
+    fprintf(stderr, "simbench: cannot write %s\n", output_name);
+    return 1;
+  }
+  print_results(out, b, (double)b.bit / AIS_BIT_RATE);
+  if (out != stdout)
+    fclose(out);
+
+  if (baseline_name && compare_baseline(baseline_name, b, tolerance))
+    return 1;
+  return 0;
+}
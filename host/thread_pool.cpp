@@ -0,0 +1,101 @@
+#include "thread_pool.h"
+
+// index of the worker running on this thread, -1 outside of pool
+static thread_local int thread_pool_worker = -1;
+static thread_local const thread_pool *thread_pool_owner = nullptr;
+
+thread_pool::thread_pool(unsigned threads)
+{
+  if (threads == 0)
+    threads = 1;
+  for (unsigned i = 0; i < threads; i++)
+    queues.emplace_back(new task_queue);
+  for (unsigned i = 0; i < threads; i++)
+    workers.emplace_back(&thread_pool::run, this, i);
+}
+
+thread_pool::~thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> guard(idle_lock);
+    stopping = true;
+  }
+  idle.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+  unsigned target;
+  if (thread_pool_owner == this)
+    target = thread_pool_worker;  // keep work local to submitting worker
+  else
+    target = next_queue++ % queues.size();
+
+  pending++;
+  {
+    std::lock_guard<std::mutex> guard(idle_lock);
+    queued++;                     // counted first, so take() never finds more tasks than queued
+  }
+  {
+    std::lock_guard<std::mutex> guard(queues[target]->lock);
+    queues[target]->tasks.push_back(std::move(task));
+  }
+  idle.notify_one();
+}
+
+void thread_pool::wait()
+{
+  std::unique_lock<std::mutex> guard(idle_lock);
+  done.wait(guard, [this] { return pending == 0; });
+}
+
+// takes task from own queue or steals one from another worker
+bool thread_pool::take(unsigned self, std::function<void()> &task)
+{
+  {
+    task_queue &own = *queues[self];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues.size(); i++) {
+    task_queue &victim = *queues[(self + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void thread_pool::run(unsigned self)
+{
+  thread_pool_worker = self;
+  thread_pool_owner = this;
+
+  std::function<void()> task;
+  for (;;) {
+    if (take(self, task)) {
+      queued--;
+      task();
+      task = nullptr;
+      if (--pending == 0) {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        done.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(idle_lock);
+    idle.wait(guard, [this] { return stopping || queued > 0; });
+    if (stopping && queued == 0)
+      return;
+  }
+}
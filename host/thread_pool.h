@@ -0,0 +1,48 @@
+/*
+ * Work-stealing thread pool. Every worker owns a task queue, tasks submitted
+ * by a worker go to its own queue (LIFO), idle workers steal from the other
+ * queues (FIFO).
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool {
+public:
+  explicit thread_pool(unsigned threads = std::thread::hardware_concurrency());
+  ~thread_pool();
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  void submit(std::function<void()> task);
+  void wait();                    // blocks until all submitted tasks have finished
+  unsigned size() const { return (unsigned)workers.size(); }
+
+private:
+  struct task_queue {
+    std::mutex lock;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  void run(unsigned self);
+  bool take(unsigned self, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<task_queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> queued{0};  // tasks waiting in queues
+  std::atomic<size_t> pending{0}; // tasks submitted but not finished
+  std::atomic<unsigned> next_queue{0};
+  std::mutex idle_lock;
+  std::condition_variable idle;   // signalled when tasks are queued
+  std::condition_variable done;   // signalled when pending drops to 0
+  bool stopping = false;
+};